@@ -1,40 +1,439 @@
 #include "CommConnection.h"
+#include "IoReactor.h"
 #include <cstdio>
+#include <cerrno>
+#if defined(__linux__) || defined(__linux) || defined(linux)
+    #include <sys/eventfd.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <errno.h>
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/socket.h>
+#endif
+
+LowLatencyOptions::LowLatencyOptions(const int &readerCore, const int &consumerCore, const unsigned int &spinMicros, const int &busyPollMicros, const int &fifoPriority) {
+	this->readerCore = readerCore;
+	this->consumerCore = consumerCore;
+	this->spinMicros = spinMicros;
+	this->busyPollMicros = busyPollMicros;
+	this->fifoPriority = fifoPriority;
+}
+
+CommConnection::ReadStatus CommConnection::readOnce() {
+	BufferRegion regions[2];
+	char discard[_DISCARD_SIZE];
+	int regionCount;
+	if(prepareRead(regions, regionCount, discard) == READ_FULL) {
+		return READ_FULL;
+	}
+	return completeRead(regions, getData(regions, regionCount), discard);
+}
+
+CommConnection::ReadStatus CommConnection::prepareRead(BufferRegion regions[2], int &regionCount, char *discard) {
+	while(true) {
+		size_t unread = buffer.available();
+		if(overflowing && unread <= drainedLevel()) {
+			overflowing = false;
+		} else if(!overflowing && highWatermark > 0 && unread >= highWatermark) {
+			overflowing = true;
+		}
+		regionCount = overflowing ? 0 : buffer.writeRegions(regions);
+		if(regionCount > 0 && readReserve > 0 && regions[0].length+(regionCount > 1 ? regions[1].length : 0) < readReserve) {
+			regionCount = 0;
+		}
+		if(regionCount > 0 || overflowPolicy != OVERFLOW_DROP_OLDEST || dropOldest() == 0) {
+			break;
+		}
+	}
+	if(regionCount == 0) {
+		overflowing = true;
+		if(overflowPolicy == OVERFLOW_BLOCK) {
+			// leave the data with the connection until the user has made room for it
+			return READ_FULL;
+		}
+		// the connection is kept drained but the data is thrown away
+		regions[0].data = discard;
+		regions[0].length = _DISCARD_SIZE;
+		regionCount = 1;
+	}
+	return READ_DATA;
+}
+
+CommConnection::ReadStatus CommConnection::completeRead(const BufferRegion *regions, const int &bytesRead, const char *discard) {
+	if(bytesRead > 0 && regions[0].data == discard) {
+		dropped += bytesRead;
+		return READ_DATA;
+	} else if(bytesRead > 0) {
+		buffer.commitWrite(bytesRead);
+		if(overflowPolicy == OVERFLOW_DROP_OLDEST) {
+			size_t consumed = buffer.position();
+			while(!chunkEnds.empty() && chunkEnds.front() <= consumed) {
+				chunkEnds.pop_front();
+			}
+			chunkEnds.push_back(buffer.writePosition());
+		}
+		notifyArrival(regions, bytesRead);
+		return READ_DATA;
+	}
+	return bytesRead < 0 ? READ_FAILED : READ_NONE;
+}
+
+void CommConnection::notifyArrival(const BufferRegion *regions, const size_t &length) {
+	// pairs with the fence in waitForCondition(4) so either the user sees the new data or this sees wantedBytes
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	size_t wanted = wantedBytes.load(std::memory_order_relaxed);
+	if(wanted == 0) {
+		return;
+	}
+	bool met = buffer.available() >= wanted;
+	int delim = waitDelim.load(std::memory_order_relaxed);
+	if(!met && delim >= 0) {
+		// only the new bytes need to be looked at, anything older was there when the user last checked
+		size_t first = length < regions[0].length ? length : regions[0].length;
+		met = memchr(regions[0].data, delim, first) != NULL || (length > first && memchr(regions[1].data, delim, length-first) != NULL);
+	}
+	if(met && watchArmed.load(std::memory_order_relaxed)) {
+		fireWatch();
+	} else if(met) {
+		// taking the mutex keeps the notify from landing between the user's check and its wait
+		std::lock_guard<std::mutex> lk(dataMutex);
+		cv.notify_all();
+	}
+}
+
+void CommConnection::fireWatch() {
+	if(!watchArmed.exchange(false)) {
+		return;
+	}
+	// the watch is cleared before the callback runs, since it may lead to the next watch being set
+	ArrivalCallback callback = watchCallback;
+	wantedBytes.store(0, std::memory_order_relaxed);
+	waitDelim.store(-1, std::memory_order_relaxed);
+	callback(this);
+}
+
+bool CommConnection::findDelimiter(const char &delim, const size_t &limit, size_t &offset) {
+	offset = 0;
+	if(scanDelim == delim && scanPosition > buffer.position()) {
+		offset = scanPosition-buffer.position();
+		if(offset > limit) {
+			offset = limit;
+		}
+	}
+	if(buffer.find(delim, offset, limit)) {
+		return true;
+	}
+	scanDelim = delim;
+	scanPosition = buffer.position()+offset;
+	return false;
+}
+
+bool CommConnection::takeAt(const size_t &start, char *buff, const size_t &length, const size_t &skip) {
+	// consumeAt(2) only moves tail if it is still at start, so bytes that were dropped and overwritten while they were
+	// copied are never handed over as if they were read
+	if(!buffer.copyAt(start, buff, length) || !buffer.consumeAt(start, length+skip)) {
+		return false;
+	}
+	notifyConsumed();
+	return true;
+}
+
+bool CommConnection::conditionMet(const size_t &bytes, const int &delim, const size_t &limit, size_t &offset) {
+	return buffer.available() >= bytes || (delim >= 0 && findDelimiter((char) delim, limit, offset));
+}
+
+bool CommConnection::waitForCondition(const size_t &bytes, const int &delim, const size_t &limit, const int &timeout) {
+	size_t offset;
+	if(conditionMet(bytes, delim, limit, offset)) {
+		return true;
+	}
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point deadline = now+std::chrono::milliseconds(timeout);
+	if(lowLatency.spinMicros > 0) {
+		// watch buffer without sleeping, so data that comes quickly is seen without a context switch
+		std::chrono::steady_clock::time_point end = now+std::chrono::microseconds(lowLatency.spinMicros);
+		while(std::chrono::steady_clock::now() < end) {
+			if(conditionMet(bytes, delim, limit, offset)) {
+				return true;
+			}
+			cpuRelax();
+		}
+	}
+	// ask the connection not to wake the reader for less than is missing, so it doesn't hand over a frame piece by piece
+	size_t unread = buffer.available();
+	size_t room = buffer.size() > unread ? buffer.size()-unread : 0;
+	size_t missing = bytes > unread ? bytes-unread : 0;
+	bool threshold = delim < 0 && missing >= _READ_THRESHOLD_MIN;
+	if(threshold) {
+		setReadThreshold(missing < room/2 ? missing : room/2);
+	}
+	{
+		std::unique_lock<std::mutex> lk(dataMutex);
+		waitDelim.store(delim, std::memory_order_relaxed);
+		wantedBytes.store(bytes, std::memory_order_relaxed);
+		// pairs with the fence in notifyArrival(2)
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(timeout < 0) {
+			cv.wait(lk, [&]{ return this->terminated || this->interruptRead || this->conditionMet(bytes, delim, limit, offset); });
+		} else {
+			cv.wait_until(lk, deadline, [&]{ return this->terminated || this->interruptRead || this->conditionMet(bytes, delim, limit, offset); });
+		}
+		wantedBytes.store(0, std::memory_order_relaxed);
+		waitDelim.store(-1, std::memory_order_relaxed);
+	}
+	if(threshold) {
+		setReadThreshold(1);
+	}
+	return conditionMet(bytes, delim, limit, offset);
+}
 
 void CommConnection::performReads() {
-	char buff[_MAX_DATA_LENGTH];
-	memset(buff, 0, _MAX_DATA_LENGTH);
-	int bytesRead;
+	bool canPoll = wakeFd >= 0 && getFileDescriptor() >= 0;
+	if(lowLatency.readerCore >= 0 || lowLatency.fifoPriority > 0) {
+		tuneThread(lowLatency.readerCore, lowLatency.fifoPriority);
+	}
 	while(!interruptRead) {
-		bytesRead = getData(buff, _MAX_DATA_LENGTH);
- 	    if (bytesRead > 0) {
-	        fillBuffer(buff, bytesRead);
-	        cvBool = true;
-	        cv.notify_one();
-	    } else if(bytesRead < 0 && blockingTime < 0) {
+		// getFileDescriptor() is checked every time since failedRead() may replace it
+		if(!waitForReadable(getFileDescriptor(), blockingTime > 0 ? blockingTime : -1, lowLatency.spinMicros)) {
+			continue;
+		}
+		ReadStatus status = readOnce();
+		if(status == READ_FULL) {
+			waitForSpace();
+		} else if(status == READ_FAILED && (blockingTime < 0 || (connected && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))) {
+			// a connection that doesn't block only fails for real when it says something other than that it has no data
 			failedRead();
-		} else if(blockingTime > 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(blockingTime));
-        }
+		} else if(status != READ_DATA && blockingTime > 0 && !canPoll) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(blockingTime));
+		}
 	}
+	// the user may be waiting for data that will now never come
+	{
+		std::lock_guard<std::mutex> lk(dataMutex);
+	}
+	cv.notify_all();
+	fireWatch();
 }
 
-void CommConnection::fillBuffer(char *buff, const int &bytesRead) {
-	int newWriteIndex = bytesRead+writeIndex;
-	if(newWriteIndex < _BUFFER_SIZE) {
-		memcpy(&buffer[writeIndex], buff, bytesRead);
-		writeIndex = newWriteIndex;
-	} else {
-		int overflow = newWriteIndex-_BUFFER_SIZE;
-		int underflow = _BUFFER_SIZE-writeIndex;
-		memcpy(&buffer[writeIndex], buff, underflow);
-		memcpy(buffer, &buff[underflow], overflow);
-		writeIndex = overflow;
+size_t CommConnection::drainedLevel() const {
+	if(lowWatermark > 0) {
+		return lowWatermark;
+	} else if(highWatermark > 0) {
+		return highWatermark/2;
+	}
+	// without watermarks, any room getData(2) can use is enough
+	size_t reserve = readReserve > 0 ? readReserve : 1;
+	return buffer.size() > reserve ? buffer.size()-reserve : 0;
+}
+
+void CommConnection::waitForSpace() {
+	std::unique_lock<std::mutex> lk(dataMutex);
+	readerWaiting.store(true);
+	spaceCv.wait(lk, [this]{ return this->interruptRead || this->buffer.available() <= this->drainedLevel(); });
+	readerWaiting.store(false);
+}
+
+size_t CommConnection::dropOldest() {
+	size_t newest = buffer.writePosition();
+	size_t level = drainedLevel();
+	size_t target = buffer.position()+1;
+	if(newest > level && newest-level > target) {
+		target = newest-level;
+	}
+	while(!chunkEnds.empty() && chunkEnds.front() < target) {
+		chunkEnds.pop_front();
+	}
+	size_t dropCount = buffer.dropTo(chunkEnds.empty() ? newest : chunkEnds.front());
+	dropped += dropCount;
+	return dropCount;
+}
+
+void CommConnection::notifyConsumed() {
+	if(overflowPolicy != OVERFLOW_BLOCK) {
+		return;
+	}
+	// pairs with the reader setting readerWaiting so either it sees the consumed data or this sees readerWaiting
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(readerWaiting.load(std::memory_order_relaxed) && buffer.available() <= drainedLevel()) {
+		if(reactor != NULL) {
+			// whoever clears readerWaiting is the one who rearms the connection
+			if(readerWaiting.exchange(false)) {
+				reactor->resume(this);
+			}
+		} else {
+			std::lock_guard<std::mutex> lk(dataMutex);
+			spaceCv.notify_one();
+		}
+	}
+}
+
+int CommConnection::getData(BufferRegion *regions, const int &regionCount) {
+	return getData(regions[0].data, regions[0].length);
+}
+
+int CommConnection::getFileDescriptor() const {
+	return -1;
+}
+
+void CommConnection::wakeReader() {
+}
+
+bool CommConnection::reconnectsWhenLost() const {
+	return false;
+}
+
+bool CommConnection::startReconnect(const int &error) {
+	if(!reconnectsWhenLost()) {
+		return false;
+	}
+	// closeThread() sets interruptRead under dataMutex before it joins readThread, so nothing is started after that
+	std::lock_guard<std::mutex> lk(dataMutex);
+	if(interruptRead || terminated) {
+		return false;
+	}
+	if(readThread != NULL) {
+		// the last reconnect handed the connection back before it could be lost again, so it is done or nearly so
+		readThread->join();
+		delete readThread;
+	}
+	connected = false;
+	readThread = new std::thread(&CommConnection::reconnectForReactor, this, error);
+	return true;
+}
+
+void CommConnection::reconnectForReactor(const int &error) {
+	errno = error;
+	failedRead();
+	// terminate() joins this thread before it removes the connection from reactor, so reactor is still there
+	if(connected && !interruptRead && reactor != NULL) {
+		// the new socket took over the old one's number, but it is a different file to poll
+		reactor->remove(this);
+		if(reactor->add(this)) {
+			return;
+		}
+	}
+	connected = false;
+	{
+		std::lock_guard<std::mutex> lk(dataMutex);
+		interruptRead = true;
+	}
+	cv.notify_all();
+	fireWatch();
+}
+
+void CommConnection::setReadThreshold(const int &bytes) {
+}
+
+bool CommConnection::readsInPlace() const {
+	return true;
+}
+
+bool CommConnection::waitForReadable(const int &fd, const int &timeout, const unsigned int &spinMicros) {
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	if(fd >= 0 && wakeFd >= 0) {
+		struct pollfd fds[2];
+		fds[0].fd = fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = wakeFd;
+		fds[1].events = POLLIN;
+		int ready = 0;
+		if(spinMicros > 0) {
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now()+std::chrono::microseconds(spinMicros);
+			while((ready = poll(fds, 2, 0)) == 0 && std::chrono::steady_clock::now() < end) {
+				cpuRelax();
+			}
+		}
+		if(ready == 0) {
+			ready = poll(fds, 2, timeout);
+		}
+		if(ready <= 0) {
+			return false;
+		}
+		// a hang up or error is reported as readable so the read can fail and be handled
+		return fds[0].revents != 0 && fds[1].revents == 0;
+	}
+#endif
+	return true;
+}
+
+bool CommConnection::waitForWritable(const int &fd, const int &timeout) {
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	if(fd >= 0 && wakeFd >= 0) {
+		struct pollfd fds[2];
+		fds[0].fd = fd;
+		fds[0].events = POLLOUT;
+		fds[1].fd = wakeFd;
+		fds[1].events = POLLIN;
+		if(poll(fds, 2, timeout) <= 0) {
+			return false;
+		}
+		// a hang up or error is reported as writable so the write can fail and be handled
+		return fds[0].revents != 0 && fds[1].revents == 0;
+	}
+#endif
+	return true;
+}
+
+bool CommConnection::tuneThread(const int &core, const int &fifoPriority) {
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	bool tuned = true;
+	if(core >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(core, &cpus);
+		if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+			fprintf(stderr, "Could not pin a thread to core %d\n", core);
+			tuned = false;
+		}
+	}
+	if(fifoPriority > 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = fifoPriority;
+		int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if(error != 0) {
+			fprintf(stderr, "Could not make a thread SCHED_FIFO with error %d\n", error);
+			tuned = false;
+		}
+	}
+	return tuned;
+#else
+	return core < 0 && fifoPriority <= 0;
+#endif
+}
+
+void CommConnection::applyLowLatency() {
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	int fd = getFileDescriptor();
+	if(lowLatency.busyPollMicros > 0 && fd >= 0) {
+		// serial ports aren't sockets, so ENOTSOCK just means there is nothing to busy poll
+		if(setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &lowLatency.busyPollMicros, sizeof(lowLatency.busyPollMicros)) < 0 && errno != ENOTSOCK) {
+			fprintf(stderr, "Could not set SO_BUSY_POLL with error %d\n", errno);
+		}
+	}
+#endif
+	if(lowLatency.consumerCore >= 0) {
+		tuneThread(lowLatency.consumerCore, 0);
 	}
 }
 
 void CommConnection::closeThread() {
-	interruptRead = true;
+	{
+		std::lock_guard<std::mutex> lk(dataMutex);
+		interruptRead = true;
+		spaceCv.notify_all();
+	}
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	if(wakeFd >= 0) {
+		// the eventfd is left signalled, since nothing waits on it once interruptRead is set
+		uint64_t one = 1;
+		if(::write(wakeFd, &one, sizeof(one)) < 0 && debug) {
+			printf("Could not wake the reading thread. errno = %d\n", errno);
+		}
+	}
+#endif
+	wakeReader();
 	if(readThread != NULL && readThread->joinable()) {
 		readThread->join();
 		delete readThread;
@@ -42,24 +441,47 @@ void CommConnection::closeThread() {
 	}
 }
 
-CommConnection::CommConnection(const int &blockingTime, const bool &debug, const bool &noReads) {
+CommConnection::CommConnection(const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : buffer(bufferOptions) {
     this->blockingTime = blockingTime;
     this->debug = debug;
 	this->noReads = noReads;
 	connected = false;
 	interruptRead = false;
+	begun = false;
 	terminated = false;
-	cvBool = false;
-	buffer = new char[_BUFFER_SIZE+1];
-	memset(buffer, 0, _BUFFER_SIZE+1);
-	readIndex = 0;
-	writeIndex = 0;	
+	wantedBytes = 0;
+	waitDelim = -1;
+	watchArmed = false;
+	readThread = NULL;
+	scanPosition = 0;
+	scanDelim = 0;
+	overflowPolicy = OVERFLOW_BLOCK;
+	highWatermark = 0;
+	lowWatermark = 0;
+	dropped = 0;
+	overflowing = false;
+	readReserve = 0;
+	readerWaiting = false;
+	reactor = NULL;
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#else
+	wakeFd = -1;
+#endif
 }
 
-CommConnection::CommConnection(const CommConnection &other) {
+CommConnection::CommConnection(const CommConnection &other) : buffer(other.buffer.getOptions()) {
     if(this == &other) {
         return;
     }
+#if defined(__linux__) || defined(__linux) || defined(linux)
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#else
+    wakeFd = -1;
+#endif
+    wantedBytes = 0;
+    waitDelim = -1;
+    watchArmed = false;
     *this = other;
 }
 
@@ -67,17 +489,24 @@ CommConnection &CommConnection::operator=(const CommConnection &other) {
     if(this == &other) {
         return *this;
     }
-    buffer = new char[_BUFFER_SIZE+1];
-    memcpy(buffer, other.buffer, _BUFFER_SIZE+1);
-    readIndex = other.readIndex;
-    writeIndex = other.writeIndex;
+    buffer = other.buffer;
     blockingTime = other.blockingTime;
     connected = other.connected;
     interruptRead = other.interruptRead;
     noReads = other.noReads;
     begun = other.begun;
     terminated = other.terminated;
-    cvBool = other.cvBool;
+    scanPosition = other.scanPosition;
+    scanDelim = other.scanDelim;
+    overflowPolicy = other.overflowPolicy;
+    highWatermark = other.highWatermark;
+    lowWatermark = other.lowWatermark;
+    dropped = other.dropped.load();
+    overflowing = false;
+    readReserve = other.readReserve;
+    readerWaiting = false;
+    reactor = NULL;
+    lowLatency = other.lowLatency;
     debug = other.debug;
     if(begun && connected) {
         begin();
@@ -85,9 +514,50 @@ CommConnection &CommConnection::operator=(const CommConnection &other) {
     return *this;
 }
 
+bool CommConnection::setBufferOptions(const BufferOptions &bufferOptions) {
+	if(begun) {
+		return false;
+	}
+	buffer.reset(bufferOptions);
+	return true;
+}
+
+bool CommConnection::useMirroredBuffer(const bool &mirrored) {
+	BufferOptions bufferOptions = buffer.getOptions();
+	bufferOptions.mirrored = mirrored;
+	return setBufferOptions(bufferOptions);
+}
+
+bool CommConnection::setOverflowPolicy(const OverflowPolicy &policy, const size_t &highWatermark, const size_t &lowWatermark) {
+	if(begun) {
+		return false;
+	}
+	overflowPolicy = policy;
+	this->highWatermark = highWatermark;
+	this->lowWatermark = lowWatermark;
+	buffer.allowProducerDrops(policy == OVERFLOW_DROP_OLDEST);
+	return true;
+}
+
+size_t CommConnection::droppedBytes() const {
+	return dropped.load();
+}
+
+bool CommConnection::setLowLatency(const LowLatencyOptions &options) {
+	if(begun) {
+		return false;
+	}
+	lowLatency = options;
+	return true;
+}
+
 bool CommConnection::begin() {
 	if(connected) {
+		if(!noReads && !buffer.allocate()) {
+			return false;
+		}
 		begun = true;
+		applyLowLatency();
 		if(!noReads) {
 			readThread = new std::thread(&CommConnection::performReads, this);
 		}
@@ -97,94 +567,116 @@ bool CommConnection::begin() {
 	}
 }
 
+bool CommConnection::begin(IoReactor *reactor) {
+	if(!connected || noReads || !buffer.allocate()) {
+		return false;
+	}
+	this->reactor = reactor;
+	if(!reactor->add(this)) {
+		this->reactor = NULL;
+		return false;
+	}
+	begun = true;
+	applyLowLatency();
+	return true;
+}
+
 unsigned int CommConnection::available() const {
-	unsigned int retval = writeIndex-readIndex;
-	if(retval < 0) 
-		retval = writeIndex+_BUFFER_SIZE-readIndex;
-	return retval;
+	return buffer.available();
 }
 
-unsigned int CommConnection::waitForData() {
-	std::unique_lock<std::mutex> lk(dataMutex);
-	cv.wait(lk, [this]{
-        if(this->cvBool) {
-            this->cvBool = false;
-            return true;
-        } else {
-            return false;
-        }
-    });
+unsigned int CommConnection::waitForData(const int &timeout) {
+	waitForCondition(1, -1, 0, timeout);
 	return available();
 }
 
-char CommConnection::read() {
-	if(available() > 0) {
-		if (readIndex + 1 < _BUFFER_SIZE) {
-			return buffer[readIndex++];
-		} else {
-			char retval = buffer[readIndex];
-			readIndex = 0;
-			return retval;
-		}
-	} else {
-		return 0;
+bool CommConnection::waitForBytes(const unsigned int &bytes, const int &timeout) {
+	return waitForCondition(bytes, -1, 0, timeout);
+}
+
+int CommConnection::waitForDelimiter(const char &delim, const int &timeout) {
+	size_t offset;
+	if(!waitForCondition((size_t) -1, (unsigned char) delim, (size_t) -1, timeout) || !findDelimiter(delim, (size_t) -1, offset)) {
+		return -1;
 	}
+	return offset;
 }
 
-void CommConnection::read(char *buff, const unsigned int &bytesToRead) {
-	if(bytesToRead <= available()) {
-		int newReadIndex = readIndex+bytesToRead;
-		if(newReadIndex < _BUFFER_SIZE) {
-			memcpy(buff, &buffer[readIndex], bytesToRead);
-			readIndex = newReadIndex;
-		} else {
-			int overflow = newReadIndex-_BUFFER_SIZE;
-			int underflow = _BUFFER_SIZE-readIndex;
-			memcpy(buff, &buffer[readIndex], underflow);
-			memcpy(&buff[underflow], buffer, overflow);
-			readIndex = overflow;
-		}
+bool CommConnection::watchFor(const size_t &bytes, const int &delim, const ArrivalCallback &callback) {
+	size_t offset;
+	if(terminated || interruptRead || conditionMet(bytes, delim, bytes, offset)) {
+		return true;
 	}
+	watchCallback = callback;
+	waitDelim.store(delim, std::memory_order_relaxed);
+	wantedBytes.store(bytes > 0 ? bytes : 1, std::memory_order_relaxed);
+	// releases watchCallback to the reader, whose exchange in fireWatch() is the acquire before it copies it
+	watchArmed.store(true, std::memory_order_release);
+	// pairs with the fence in notifyArrival(2), so either the reader sees the watch or this sees the data
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if((terminated || interruptRead || conditionMet(bytes, delim, bytes, offset)) && watchArmed.exchange(false)) {
+		wantedBytes.store(0, std::memory_order_relaxed);
+		waitDelim.store(-1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+char CommConnection::read() {
+	char retval = 0;
+	buffer.read(&retval, 1);
+	notifyConsumed();
+	return retval;
+}
+
+void CommConnection::read(char *buff, const unsigned int &bytesToRead) {
+	buffer.read(buff, bytesToRead);
+	notifyConsumed();
 }
 
 // does not put the delim character in the buff 
-int CommConnection::readUntil(char *buff, const int &buffSize, const char &delim) { // TODO this needs work! Can't handle wrap around case
-	int i = readIndex, count = 0, leftOff = 0;
+int CommConnection::readUntil(char *buff, const int &buffSize, const char &delim) {
+	size_t offset;
 	while(true) {
-		if(available() > 0) {
-			if(buffer[i] == delim) {
-				memcpy(&buff[leftOff], &buffer[readIndex], i-readIndex);
-				readIndex = i+1;
-				return count;
-			} else if(i == _BUFFER_SIZE) {
-				memcpy(&buff[leftOff], &buffer[readIndex], i-readIndex);
-				leftOff = i-readIndex;
-				readIndex = 0;
-				i = 0;
-			} else {
-				i++;
+		// where the search starts, so nothing is taken if the reader drops what was searched before it is read
+		size_t start = buffer.position();
+		if(findDelimiter(delim, buffSize, offset)) {
+			if(takeAt(start, buff, offset, 1)) {
+				return offset;
 			}
-			count++;
-			if(count == buffSize) {
-				return count;
+		} else if(offset == (size_t) buffSize) {
+			if(takeAt(start, buff, offset, 0)) {
+				return offset;
 			}
+		} else if(!waitForCondition(buffSize, (unsigned char) delim, buffSize, -1)) {
+			return -1;
 		}
 	}
 }
 
 std::string CommConnection::readString(const unsigned int &bytesToRead) {
-    unsigned int goingToRead = bytesToRead;
-    if(goingToRead < 0) {
-        goingToRead = available();
-    }
-	if(goingToRead <= available()) {
-	    char buff[goingToRead];
-	    memset(buff, 0, goingToRead);
-	    read(buff, goingToRead);
-	    return std::string(buff);
-	} else {
+	// the bytes are taken in one read, which only succeeds if none of them were dropped under OVERFLOW_DROP_OLDEST
+	if(bytesToRead == (unsigned int) -1) {
+		std::string data(available(), '\0');
+		data.resize(buffer.readSome(&data[0], data.size()));
+		notifyConsumed();
+		return data;
+	}
+	std::string data(bytesToRead, '\0');
+	if(bytesToRead == 0 || !buffer.read(&data[0], bytesToRead)) {
 		return std::string("");
 	}
+	notifyConsumed();
+	return data;
+}
+
+int CommConnection::peek(BufferSpan spans[2]) {
+	return buffer.peek(spans);
+}
+
+void CommConnection::consume(const unsigned int &bytesToConsume) {
+	buffer.consume(bytesToConsume);
+	notifyConsumed();
 }
 
 bool CommConnection::isConnected() const {
@@ -192,14 +684,24 @@ bool CommConnection::isConnected() const {
 }
 
 void CommConnection::clearBuffer() {
-	readIndex = writeIndex;
+	buffer.clear();
+	notifyConsumed();
 }
 
 void CommConnection::terminate() {
 	if(!terminated) {
-		terminated = true;
-        cvBool = true;
+		{
+			std::lock_guard<std::mutex> lk(dataMutex);
+			terminated = true;
+		}
         cv.notify_all();
+		fireWatch();
+		if(reactor != NULL) {
+			// a reconnect in progress is stopped first, since it hands the connection back to reactor when it is done
+			closeThread();
+			reactor->remove(this);
+			reactor = NULL;
+		}
 		closeThread();
 		//delete[] buffer;
 		exitGracefully();
@@ -212,4 +714,9 @@ bool CommConnection::write(const std::string &buff) {
 
 CommConnection::~CommConnection() {
     terminate();
+#if defined(__linux__) || defined(__linux) || defined(linux)
+    if(wakeFd >= 0) {
+        close(wakeFd);
+    }
+#endif
 }
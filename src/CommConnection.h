@@ -8,30 +8,118 @@
 #include <string>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include "RingBuffer.h"
 
-// size of the buffer that is filled when a read is preformed
-#define _MAX_DATA_LENGTH 4096
-// size of the circular buffer that the user is served data from
+// default size of the circular buffer that the user is served data from
 // 4194304 = 2^22 = 4MB
 #define _BUFFER_SIZE 4194304
+// size of the scratch space OVERFLOW_DROP_NEWEST reads data into to throw it away
+#define _DISCARD_SIZE 65536
+// waitForBytes(2) only sets SO_RCVLOWAT when it is missing at least this many bytes, since setting it costs 2 syscalls
+#define _READ_THRESHOLD_MIN 4096
+
+// tells the processor it is in a spin loop, so it can save power and give way to the other hyperthread
+static inline void cpuRelax() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_ia32_pause();
+#endif
+}
+
+// what the reading thread does when buffer fills up
+enum OverflowPolicy {
+	// stop reading from the connection until the user drains buffer, so flow control can slow the sender down
+	OVERFLOW_BLOCK,
+	// keep reading from the connection but throw the new data away
+	OVERFLOW_DROP_NEWEST,
+	// throw away the oldest whole chunks of unread data to make room for the new data
+	OVERFLOW_DROP_OLDEST
+};
+
+// opt in settings that trade CPU time for lower latency between data arriving and the user seeing it
+struct LowLatencyOptions {
+	// the core the reading thread is pinned to, or -1 to leave it to the scheduler
+	int readerCore;
+	// the core the thread that calls begin() is pinned to, or -1 to leave it to the scheduler
+	int consumerCore;
+	// how long in microseconds the reader and waitForData() spin before falling back to blocking. 0 never spins
+	unsigned int spinMicros;
+	// SO_BUSY_POLL for sockets, how long in microseconds the kernel busy polls the device for a blocking read. 0 leaves it off
+	int busyPollMicros;
+	// runs the reading thread as SCHED_FIFO with this priority, which usually needs CAP_SYS_NICE. 0 leaves it alone
+	int fifoPriority;
+
+	LowLatencyOptions(const int &readerCore = -1, const int &consumerCore = -1, const unsigned int &spinMicros = 0, const int &busyPollMicros = 0, const int &fifoPriority = 0);
+};
+
+class IoReactor;
+class UringReactor;
+class AsyncConnection;
+class CommConnection;
+
+// is called by the reading thread once what watchFor(3) asked for has arrived, or the connection has stopped reading
+typedef std::function<void(CommConnection *)> ArrivalCallback;
 
 class CommConnection {
+	friend class IoReactor;
+	friend class UringReactor;
+	friend class AsyncConnection;
 protected:
+	// the outcome of readOnce()
+	enum ReadStatus {
+		// data was moved out of the connection
+		READ_DATA,
+		// getData(2) returned 0
+		READ_NONE,
+		// getData(2) returned less than 0, errno tells why
+		READ_FAILED,
+		// nothing was read because OVERFLOW_BLOCK is waiting for the user to make room in buffer
+		READ_FULL
+	};
+
 	// a circular buffer that holds the data read from a connection until the user requests it
-	char *buffer;
-	// indexes related to buffer. The readIndex cannot pass the writeIndex.
-	int readIndex, writeIndex;
-	// the amount of time preformReads() will wait before trying to read again
-	// if less than 0, it will block indefinitely
-	// if equal to 0, it will never block and will continuously try to read data
-	// if more than 0, it will wait that long in milliseconds
+	// performReads() is its only producer and the user is its only consumer
+	// it is allocated by begin(), and never if noReads is set
+	RingBuffer buffer;
+	// how far readUntil() has searched buffer for scanDelim, as a RingBuffer::position(), so no byte is searched twice
+	size_t scanPosition;
+	char scanDelim;
+	// what performReads() does when buffer holds highWatermark bytes, or is full if highWatermark is 0
+	OverflowPolicy overflowPolicy;
+	// once buffer has overflowed, performReads() goes back to reading normally when it has drained to lowWatermark
+	size_t highWatermark, lowWatermark;
+	// the number of bytes that overflowPolicy has thrown away
+	std::atomic<size_t> dropped;
+	// the buffer position at the end of each read, so OVERFLOW_DROP_OLDEST can drop whole chunks. Only used by performReads()
+	std::deque<size_t> chunkEnds;
+	// whether readOnce() is past highWatermark and hasn't drained to lowWatermark yet. Only used by the reader
+	bool overflowing;
+	// the least free space getData(2) can use, for children that write whole records. Less than that counts as full
+	size_t readReserve;
+	// set while the reader is waiting for the user to drain buffer under OVERFLOW_BLOCK
+	std::atomic<bool> readerWaiting;
+	// the condition variable performReads() waits on for space in buffer. It uses dataMutex
+	std::condition_variable spaceCv;
+	// how performReads() waits for data when there is none
+	// if less than 0, the connection blocks and a failed read is handed to failedRead()
+	// if equal to 0, the connection doesn't block and performReads() waits for data without a time limit
+	// if more than 0, the connection doesn't block and performReads() waits at most that long in milliseconds
+	// on Linux the waiting is done in poll(2), so data is read as soon as it arrives and terminate() can interrupt it
 	int blockingTime;
 	// flag to indicate if the connection is connected. This is not always useful, such as with serial devices
 	volatile bool connected;
 	// flag to indicate whether to program has been asked to stop reading and terminate
 	volatile bool interruptRead;
-	// flag that allows for waitForData() to be notified when there is new data
-    volatile bool cvBool;
+	// what the user is waiting for in waitForCondition(4). The reader only notifies cv once it has happened
+	// wantedBytes is 0 when no one is waiting and waitDelim is -1 when the user isn't waiting for a delimiter
+	std::atomic<size_t> wantedBytes;
+	std::atomic<int> waitDelim;
+	// what watchFor(3) calls instead of the reader notifying cv. It is only called if watchArmed is still set,
+	// and whoever clears watchArmed is the one that acts on it, so it is never called twice for one watch
+	ArrivalCallback watchCallback;
+	std::atomic<bool> watchArmed;
     // flag to indicate if this CommConnection is never going to read data from its connection
 	bool noReads;
 	// flags related to whether the reading thread is running
@@ -40,57 +128,169 @@ protected:
 	bool debug;
 	// does the reading from the connection by running performReads()
 	std::thread *readThread;
-	// the mutex that prevents waitForData() from prematurely telling the user there is data
+	// does the reading from the connection instead of readThread if begin(1) was given one
+	IoReactor *reactor;
+	// the mutex that keeps the reader from notifying cv between the user's check for data and its wait
 	std::mutex dataMutex;
 	// the condition variable that uses the above mutex
 	std::condition_variable cv;
+	// an eventfd(2) that is signalled to wake anything waiting in waitForReadable(2), or -1 if there isn't one
+	int wakeFd;
+	LowLatencyOptions lowLatency;
 
-	// calls getData(2) and fillBuffer(2)
+	// calls getData(2) once with the free space in buffer so the data is received in place
+	// notifies cv when the user is waiting for what arrived, and applies overflowPolicy when buffer is full
+	ReadStatus readOnce();
+	// picks the regions of buffer the next read goes into, applying overflowPolicy when buffer is full
+	// regions[0] is discard, which must hold _DISCARD_SIZE bytes, when the data is to be thrown away
+	// returns READ_FULL if nothing should be read until the user makes room, otherwise READ_DATA
+	ReadStatus prepareRead(BufferRegion regions[2], int &regionCount, char *discard);
+	// hands what a read into the regions from prepareRead(3) returned to buffer, and to the user if they are waiting for it
+	// returns what readOnce() would for that read
+	ReadStatus completeRead(const BufferRegion *regions, const int &bytesRead, const char *discard);
+	// tells a user waiting in waitForCondition(4) about the length bytes just written to regions, if it is what they want
+	void notifyArrival(const BufferRegion *regions, const size_t &length);
+	// blocks the user until buffer holds bytes bytes, delim is found within limit bytes if delim isn't -1,
+	// or the reader stops. Waits at most timeout milliseconds, or forever if timeout is negative
+	// returns whether what was waited for is in buffer
+	bool waitForCondition(const size_t &bytes, const int &delim, const size_t &limit, const int &timeout);
+	// returns whether enough bytes or the delimiter are in buffer, as waitForCondition(4) means them
+	// offset is set to where delim is when it is found
+	bool conditionMet(const size_t &bytes, const int &delim, const size_t &limit, size_t &offset);
+	// calls the callback from watchFor(3) if it is armed. Called when the reader stops, so no one watches forever
+	void fireWatch();
+	// searches for delim within limit bytes of the oldest unread byte, picking up where the last search stopped
+	// returns true and sets offset to where delim is if it is found, otherwise sets offset to how far it looked
+	bool findDelimiter(const char &delim, const size_t &limit, size_t &offset);
+	// copies length bytes from start, as counted by buffer.position(), into buff and consumes them and skip bytes after them
+	// returns false and takes nothing if the reader dropped any of them under OVERFLOW_DROP_OLDEST since start was read
+	bool takeAt(const size_t &start, char *buff, const size_t &length, const size_t &skip);
+	// calls readOnce() until the connection is terminated, waiting as blockingTime and overflowPolicy say to
 	// is the function executed by readThread
-	// sets cv when there is new data
 	void performReads();
-	// fills buffer with the data that is in buff and moves the writeIndex forward by bytesRead amount
-	void fillBuffer(char *buff, const int &bytesRead);
+	// returns how far buffer has to drain before performReads() stops treating it as overflowing
+	size_t drainedLevel() const;
+	// blocks performReads() until the user has drained buffer to drainedLevel()
+	void waitForSpace();
+	// drops the oldest whole chunks in buffer until it has drained to drainedLevel(), or at least one chunk
+	// returns how many bytes were dropped
+	size_t dropOldest();
+	// wakes the reader if it is waiting for space and enough data has been consumed
+	// called after every function that consumes data
+	void notifyConsumed();
 	// attempts to stop readThread and destroy it
 	void closeThread();
+	// has readThread reconnect through failedRead() after reactor lost the connection with error, so no reactor thread
+	// waits for it. Returns false, starting nothing, if the connection doesn't reconnect or is being terminated
+	bool startReconnect(const int &error);
+	// reconnects and hands the new connection back to reactor, or marks the connection as lost if it couldn't
+	// this is the function executed by readThread after startReconnect(1)
+	void reconnectForReactor(const int &error);
+	// waits up to timeout milliseconds, or forever if timeout is negative, for fd to have something to read
+	// polls without blocking for spinMicros microseconds first, so a read that comes quickly doesn't cost a context switch
+	// returns false if it timed out or was woken by closeThread(). Returns true straight away if fd can't be polled
+	bool waitForReadable(const int &fd, const int &timeout, const unsigned int &spinMicros = 0);
+	// waits up to timeout milliseconds, or forever if timeout is negative, for fd to have room for more data
+	// returns false if it timed out or was woken by closeThread(). Returns true straight away if fd can't be polled
+	bool waitForWritable(const int &fd, const int &timeout);
+	// pins the calling thread to core, and makes it SCHED_FIFO if fifoPriority is more than 0. Returns false if either fails
+	bool tuneThread(const int &core, const int &fifoPriority);
+	// applies the parts of lowLatency that are set on the connection rather than a thread. Called by begin()
+	void applyLowLatency();
 
 	// a child class may attempt to restart the connection with this function
 	virtual void failedRead() = 0;
 	// the function that the child class implements to do the reading of the data from the connection
 	virtual int getData(char *buff, const int &buffSize) = 0;
+	// reads directly into the regions of buffer, filling them in order. Returns what getData(2) would
+	// the child class should override this when it can scatter a read across both regions, otherwise only the first is used
+	virtual int getData(BufferRegion *regions, const int &regionCount);
 	// allows for the child to clean up its objects. This is called by terminate()
 	virtual void exitGracefully() = 0;
 	// allows the child to implement how blocking is done for its connection
 	// called by the constructor
     virtual bool setBlocking(const int &blockingTime = -1) = 0;
+	// returns the file descriptor getData(2) reads from so it can be polled, or -1 if there isn't one
+	virtual int getFileDescriptor() const;
+	// wakes a reader that waits for data somewhere other than waitForReadable(3), like on a futex
+	// called by closeThread() once interruptRead is set. Does nothing by default
+	virtual void wakeReader();
+	// lets the child ask its connection not to report data as readable until it has bytes bytes, like SO_RCVLOWAT
+	// called by waitForBytes(2) and with 1 once it is done waiting. Does nothing by default
+	virtual void setReadThreshold(const int &bytes);
+	// returns whether getData(2) does nothing but read from getFileDescriptor() into the regions it is given,
+	// so a reactor can do that read itself, such as through io_uring(7). True by default
+	virtual bool readsInPlace() const;
+	// returns whether failedRead() connects again, so a reactor that loses the connection hands it to startReconnect(1)
+	// instead of marking it as lost. False by default
+	virtual bool reconnectsWhenLost() const;
 public:
-	CommConnection(const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false);
+	CommConnection(const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false, const BufferOptions &bufferOptions = BufferOptions(_BUFFER_SIZE));
     CommConnection(const CommConnection &other);
     CommConnection &operator=(const CommConnection &other);
 
-    // starts the readThread
+	// changes how buffer is sized and allocated. Returns false and does nothing if begin() has already been called
+	bool setBufferOptions(const BufferOptions &bufferOptions);
+	// makes buffer map its memory twice in a row so unread data is always contiguous and peek(1) returns 1 span
+	// returns false and does nothing if begin() has already been called
+	bool useMirroredBuffer(const bool &mirrored = true);
+	// chooses what happens when data arrives faster than it is read. The default is OVERFLOW_BLOCK
+	// buffer is treated as overflowing once it holds highWatermark bytes, or when it is full if that is 0,
+	// and until it drains to lowWatermark bytes. A lowWatermark of 0 means half of highWatermark
+	// under OVERFLOW_DROP_OLDEST, data seen through peek(1) may be dropped and overwritten if buffer overflows
+	// returns false and does nothing if begin() has already been called
+	bool setOverflowPolicy(const OverflowPolicy &policy, const size_t &highWatermark = 0, const size_t &lowWatermark = 0);
+	// returns how many bytes have been thrown away because buffer overflowed
+	size_t droppedBytes() const;
+	// turns on the low latency settings in options, which burn CPU time to cut the time from data arriving to it being read
+	// returns false and does nothing if begin() has already been called
+	bool setLowLatency(const LowLatencyOptions &options);
+    // allocates buffer and starts the readThread
 	bool begin();
+	// allocates buffer and has reactor do the reading instead of starting a thread for this connection
+	// returns false if the connection has nothing reactor can poll
+	bool begin(IoReactor *reactor);
 	// returns how many bytes are available to be read from the buffer immediately
 	unsigned int available() const;
-	// blocks until there is a byte to be read from the buffer
-	unsigned int waitForData();
-	// returns 1 byte from the buffer if one is available and moves readIndex up by 1
+	// blocks until there is a byte to be read from the buffer, or for at most timeout milliseconds if timeout isn't negative
+	// returns available(), which is 0 if it timed out or the connection was terminated
+	unsigned int waitForData(const int &timeout = -1);
+	// blocks until at least bytes bytes can be read from the buffer, or for at most timeout milliseconds if timeout isn't negative
+	// returns false if it timed out or the connection was terminated first
+	bool waitForBytes(const unsigned int &bytes, const int &timeout = -1);
+	// blocks until delim is in the buffer, or for at most timeout milliseconds if timeout isn't negative
+	// returns how many bytes come before delim, or -1 if it timed out or the connection was terminated first
+	// under OVERFLOW_DROP_OLDEST the reader may drop those bytes before they are read, so readUntil(3) should be used instead
+	int waitForDelimiter(const char &delim, const int &timeout = -1);
+	// has the reading thread call callback once buffer holds bytes bytes, or delim is within bytes bytes if delim isn't -1,
+	// or the connection stops reading, instead of a thread blocking for it. The callback should hand the work off quickly
+	// returns true, and never calls callback, if that has already happened. Only one watch can be set at a time, it is
+	// cleared once it fires, and it can't be used while a thread is waiting in one of the waitFor functions
+	bool watchFor(const size_t &bytes, const int &delim, const ArrivalCallback &callback);
+	// returns 1 byte from the buffer if one is available and consumes it
 	// if no byte is available, then it returns 0
 	char read();
-	// fills buff with bytesToRead number of bytes and moves readIndex up by bytesToRead amount
+	// fills buff with bytesToRead number of bytes and consumes them
 	// buff must be allocated by the caller and is left untouched if no bytes are available to be read
 	void read(char *buff, const unsigned int &bytesToRead);
 	// fills buff until either buffSize amount of bytes are read, or the character delim is read
-	// it will move readIndex up by the number of bytes it put into buff
+	// it consumes the bytes it put into buff and the delim
+	// blocks until one of those happens, and returns -1 if the connection is terminated while waiting
 	// buff must be allocated by the caller
 	int readUntil(char *buff, const int &buffSize, const char &delim);
 	// returns a string with bytesToRead number of characters if that many bytes can be read
 	// if no argument is provided to this function, the string that is returned has all the bytes that are in buffer
-	// it will move readIndex up by the number of bytes it put into the string
+	// it consumes the bytes it put into the string
     std::string readString(const unsigned int &bytesToRead = -1);
+	// fills spans with read only views of all the unread data in the buffer without copying or consuming it
+	// returns the number of spans filled, which is 2 when the data wraps around the end of the buffer
+	// the spans stay valid until the next call to peek(1) or to one of the functions that read data
+	int peek(BufferSpan spans[2]);
+	// moves past bytesToConsume bytes, or all of the unread bytes if there are fewer than that
+	void consume(const unsigned int &bytesToConsume);
     // returns connected
 	bool isConnected() const;
-	// sets readIndex = writeIndex
+	// discards all the unread data in buffer
 	void clearBuffer();	
 	// shuts down the connection, and attempts to terminate the read thread
 	// calls exitGracefully()
@@ -0,0 +1,248 @@
+#pragma once
+#ifndef COMMCOROUTINE_H
+#define COMMCOROUTINE_H
+
+#include "CommConnection.h"
+
+// the library itself is built as C++11, so this is only there for code that includes it while being built as C++20
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <optional>
+#include <exception>
+
+class CommScheduler;
+
+// the return type of a coroutine that CommScheduler runs. It doesn't start until it is handed to CommScheduler::spawn(1),
+// and it frees itself once it returns. Nothing can be returned from it, since nothing waits for it to finish
+class CommTask {
+	friend class CommScheduler;
+public:
+	struct promise_type {
+		// the scheduler running the coroutine, or NULL if it was never spawned
+		CommScheduler *scheduler = NULL;
+
+		CommTask get_return_object() { return CommTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		// there is no one to hand an exception to
+		void unhandled_exception() { std::terminate(); }
+		// tells the scheduler the coroutine is done
+		~promise_type();
+	};
+
+	CommTask(CommTask &&other) noexcept : handle(other.handle) { other.handle = NULL; }
+	CommTask(const CommTask &other) = delete;
+	CommTask &operator=(const CommTask &other) = delete;
+	// a coroutine that was never spawned is destroyed with it
+	~CommTask() { if(handle) handle.destroy(); }
+protected:
+	std::coroutine_handle<promise_type> handle;
+
+	explicit CommTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+};
+
+// Runs coroutines on the threads that call run(), resuming each one when what it is waiting for on its connection
+// has arrived. The reading threads only queue the coroutines they wake, so a session never runs on a reader, and one
+// thread calling run() can serve as many sessions as there are connections for.
+class CommScheduler {
+	friend struct CommTask::promise_type;
+protected:
+	std::mutex mutex;
+	// notified when a coroutine is queued, the last one finishes, or stop() is called
+	std::condition_variable cv;
+	// the coroutines that are ready to be resumed, oldest first
+	std::deque<std::coroutine_handle<>> ready;
+	// how many spawned coroutines haven't finished
+	size_t tasks = 0;
+	bool stopped = false;
+
+	// called when a spawned coroutine is done
+	void finished() {
+		std::lock_guard<std::mutex> lk(mutex);
+		if(--tasks == 0) {
+			cv.notify_all();
+		}
+	}
+public:
+	CommScheduler() = default;
+	CommScheduler(const CommScheduler &other) = delete;
+	CommScheduler &operator=(const CommScheduler &other) = delete;
+
+	// queues task to be started by run()
+	void spawn(CommTask task) {
+		std::coroutine_handle<CommTask::promise_type> handle = task.handle;
+		task.handle = NULL;
+		handle.promise().scheduler = this;
+		{
+			std::lock_guard<std::mutex> lk(mutex);
+			tasks++;
+		}
+		post(handle);
+	}
+	// queues handle to be resumed by run(). May be called from any thread
+	void post(std::coroutine_handle<> handle) {
+		{
+			std::lock_guard<std::mutex> lk(mutex);
+			ready.push_back(handle);
+		}
+		cv.notify_one();
+	}
+	// resumes coroutines as they become ready until every spawned one has finished or stop() is called
+	// may be called from several threads at once. Returns how many times a coroutine was resumed
+	size_t run() {
+		size_t resumed = 0;
+		std::unique_lock<std::mutex> lk(mutex);
+		while(true) {
+			cv.wait(lk, [this]{ return stopped || !ready.empty() || tasks == 0; });
+			if(stopped || ready.empty()) {
+				break;
+			}
+			std::coroutine_handle<> handle = ready.front();
+			ready.pop_front();
+			lk.unlock();
+			handle.resume();
+			resumed++;
+			lk.lock();
+		}
+		return resumed;
+	}
+	// resumes the coroutines that are ready without waiting for more, for a thread that has its own loop
+	// returns how many were resumed
+	size_t poll() {
+		size_t resumed = 0;
+		std::unique_lock<std::mutex> lk(mutex);
+		for(size_t count = ready.size(); count > 0 && !ready.empty(); count--) {
+			std::coroutine_handle<> handle = ready.front();
+			ready.pop_front();
+			lk.unlock();
+			handle.resume();
+			resumed++;
+			lk.lock();
+		}
+		return resumed;
+	}
+	// makes run() return once the coroutine it is resuming suspends. The coroutines that are left stay where they are
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lk(mutex);
+			stopped = true;
+		}
+		cv.notify_all();
+	}
+	// lets run() be called again after stop()
+	void restart() {
+		std::lock_guard<std::mutex> lk(mutex);
+		stopped = false;
+	}
+	// returns how many spawned coroutines haven't finished
+	size_t size() {
+		std::lock_guard<std::mutex> lk(mutex);
+		return tasks;
+	}
+};
+
+inline CommTask::promise_type::~promise_type() {
+	if(scheduler != NULL) {
+		scheduler->finished();
+	}
+}
+
+// Awaitable reads and writes on a CommConnection, for coroutines run by a CommScheduler.
+// A read that can't be done yet has the connection's reader queue the coroutine on the scheduler once the data is
+// there, through CommConnection::watchFor(3), instead of a thread blocking for it. Only one coroutine may wait on a
+// connection at a time, and no thread may use the blocking waitFor functions on it meanwhile.
+// Writes don't suspend. They call CommConnection::write(2) on the scheduler's thread, which holds up every coroutine
+// that thread runs until the data is handed over. A NetworkConnection in a queued write mode only blocks there while
+// its queue is full. Otherwise, and for a SerialConnection or UnixConnection, it waits in waitForWritable(2), and a
+// SharedMemoryConnection waits for room in the ring, for as long as the peer isn't reading.
+// The connection has to be begun before it is awaited, and has to outlive the coroutines that use it.
+class AsyncConnection {
+protected:
+	CommConnection &conn;
+	CommScheduler &scheduler;
+
+	// has the connection's reader post handle to scheduler once it holds bytes bytes, or delim within bytes bytes
+	// returns whether handle should stay suspended, which it shouldn't if that has already happened
+	bool suspend(std::coroutine_handle<> handle, const size_t &bytes, const int &delim) {
+		CommScheduler *scheduler = &this->scheduler;
+		return !conn.watchFor(bytes, delim, [scheduler, handle](CommConnection *) { scheduler->post(handle); });
+	}
+	// looks for delim within limit bytes without blocking, as CommConnection::findDelimiter(3) does
+	bool find(const char &delim, const size_t &limit, size_t &offset) {
+		return conn.findDelimiter(delim, limit, offset);
+	}
+public:
+	// what co_await readExactly(1) waits on
+	struct ReadExactly {
+		AsyncConnection &self;
+		size_t bytes;
+
+		bool await_ready() { return self.conn.available() >= bytes; }
+		bool await_suspend(std::coroutine_handle<> handle) { return self.suspend(handle, bytes, -1); }
+		std::optional<std::string> await_resume() {
+			if(self.conn.available() < bytes) {
+				return std::nullopt;
+			}
+			std::string data(bytes, '\0');
+			self.conn.read(&data[0], bytes);
+			return data;
+		}
+	};
+
+	// what co_await readUntil(2) waits on
+	struct ReadUntil {
+		AsyncConnection &self;
+		char delim;
+		size_t limit;
+
+		bool await_ready() {
+			size_t offset;
+			return self.find(delim, limit, offset) || offset >= limit;
+		}
+		bool await_suspend(std::coroutine_handle<> handle) { return self.suspend(handle, limit, (unsigned char) delim); }
+		std::optional<std::string> await_resume() {
+			size_t offset;
+			while(true) {
+				// the search is done again if the reader dropped what was found before it could be taken
+				size_t start = self.conn.buffer.position();
+				bool found = self.find(delim, limit, offset);
+				if(!found && offset < limit) {
+					return std::nullopt;
+				}
+				std::string data(offset, '\0');
+				if(self.conn.takeAt(start, &data[0], offset, found ? 1 : 0)) {
+					return data;
+				}
+			}
+		}
+	};
+
+	// what co_await write(1) waits on. It never suspends, so it blocks the scheduler's thread as the class comment says
+	// NetworkConnection::setWriteMode(WRITE_QUEUED) keeps a slow peer from holding it up for longer than the queue takes to fill
+	struct Write {
+		AsyncConnection &self;
+		std::string data;
+
+		bool await_ready() { return true; }
+		void await_suspend(std::coroutine_handle<>) {}
+		bool await_resume() { return self.conn.write(data.data(), data.size()); }
+	};
+
+	AsyncConnection(CommConnection &conn, CommScheduler &scheduler) : conn(conn), scheduler(scheduler) {}
+
+	// waits until bytes bytes have arrived and returns them, consuming them
+	// returns nothing if the connection stopped reading before that many arrived
+	ReadExactly readExactly(const size_t &bytes) { return ReadExactly{*this, bytes}; }
+	// waits until delim has arrived and returns what came before it, consuming both
+	// if limit bytes arrive without delim, returns those bytes instead, as CommConnection::readUntil(3) does
+	// returns nothing if the connection stopped reading before either happened
+	ReadUntil readUntil(const char &delim, const size_t &limit = (size_t) -1) { return ReadUntil{*this, delim, limit}; }
+	// sends data on the connection and returns whether it was sent
+	Write write(const std::string &data) { return Write{*this, data}; }
+	// returns the connection this awaits
+	CommConnection &connection() { return conn; }
+};
+
+#endif // __cplusplus >= 202002L
+#endif // COMMCOROUTINE_H
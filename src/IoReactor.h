@@ -0,0 +1,81 @@
+#pragma once
+#ifndef IOREACTOR_H
+#define IOREACTOR_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <map>
+#include "CommConnection.h"
+
+// most events one epoll_wait(4) hands back to a reactor thread
+#define _REACTOR_MAX_EVENTS 64
+// most times a connection is read from per event, so one busy connection can't starve the others
+#define _REACTOR_READS_PER_EVENT 8
+
+// Does the reading for many connections from a few threads, instead of each connection having its own readThread.
+// A connection is handed over with CommConnection::begin(IoReactor *) and is taken back by CommConnection::terminate().
+// Connections are polled with epoll(7) in one shot mode, so only one reactor thread reads from a connection at a time
+// and a connection whose buffer is full under OVERFLOW_BLOCK isn't polled again until the user has drained it.
+// A connection that fails or hangs up is marked as not connected and is no longer polled. Only available on Linux.
+// The reactor must outlive the connections that were begun with it.
+// The public functions are virtual so a reactor can do the reading another way, like UringReactor does.
+class IoReactor {
+protected:
+	// what the reactor knows about a connection it polls
+	struct Registration {
+		// a reactor thread is reading from the connection
+		bool busy;
+		// resume(1) was called while busy, so the connection should be polled again when the read is done
+		bool rearmRequested;
+		// remove(1) is waiting for the read to be done
+		bool removing;
+		// the file descriptor was already non blocking, so it can be read from until it runs dry without blocking
+		// otherwise it is only read from once per event, since only the first read is sure not to block
+		bool nonBlocking;
+	};
+
+	int threadCount;
+	bool debug;
+	// the epoll(7) instance the connections are registered with
+	int epollFd;
+	// an eventfd(2) that wakes every reactor thread so they can see that interrupt is set
+	int wakeFd;
+	std::atomic<bool> interrupt;
+	bool begun;
+	std::vector<std::thread *> threads;
+	std::map<CommConnection *, Registration> registrations;
+	std::mutex registryMutex;
+	// notified whenever a connection stops being busy
+	std::condition_variable idleCv;
+
+	// waits for events and reads from the connections they are for until terminate() is called
+	// is the function executed by each of threads
+	void run();
+	// reads from conn after epoll(7) said it was ready and decides whether it should be polled again
+	void handle(CommConnection *conn, const unsigned int &events);
+	// registers conn with epollFd when op is EPOLL_CTL_ADD, or polls it again when op is EPOLL_CTL_MOD
+	bool arm(CommConnection *conn, const int &op);
+public:
+	// nothing is read until begin() is called, but connections may be added before that
+	IoReactor(const int &threadCount = 1, const bool &debug = false);
+	virtual ~IoReactor();
+
+	// starts the reactor threads
+	virtual bool begin();
+	// stops the reactor threads. Connections are left registered until they are removed
+	virtual void terminate();
+	// starts polling conn. Called by CommConnection::begin(IoReactor *)
+	// returns false if conn has no file descriptor or it couldn't be registered
+	virtual bool add(CommConnection *conn);
+	// stops polling conn and waits for any read from it in progress to finish. Called by CommConnection::terminate()
+	virtual void remove(CommConnection *conn);
+	// polls conn again after its buffer was full under OVERFLOW_BLOCK. Called when the user has drained it
+	virtual void resume(CommConnection *conn);
+	// returns how many connections are registered
+	virtual size_t size();
+};
+
+#endif // IOREACTOR_H
@@ -0,0 +1,201 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "../IoReactor.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// protected:
+void IoReactor::run() {
+	struct epoll_event events[_REACTOR_MAX_EVENTS];
+	while(!interrupt) {
+		int eventCount = epoll_wait(epollFd, events, _REACTOR_MAX_EVENTS, -1);
+		if(eventCount < 0 && errno != EINTR) {
+			fprintf(stderr, "IoReactor failed to wait for events with errno %d\n", errno);
+			return;
+		}
+		for(int i = 0; i < eventCount; i++) {
+			CommConnection *conn = (CommConnection *) events[i].data.ptr;
+			if(conn == NULL) {
+				// wakeFd, which is left readable so every thread sees it
+				continue;
+			}
+			{
+				std::lock_guard<std::mutex> lk(registryMutex);
+				std::map<CommConnection *, Registration>::iterator it = registrations.find(conn);
+				if(it == registrations.end() || it->second.removing) {
+					continue;
+				}
+				it->second.busy = true;
+			}
+			handle(conn, events[i].events);
+		}
+	}
+}
+
+void IoReactor::handle(CommConnection *conn, const unsigned int &events) {
+	bool nonBlocking;
+	{
+		std::lock_guard<std::mutex> lk(registryMutex);
+		nonBlocking = registrations[conn].nonBlocking;
+	}
+	CommConnection::ReadStatus status = CommConnection::READ_NONE;
+	for(int i = 0; i < (nonBlocking ? _REACTOR_READS_PER_EVENT : 1); i++) {
+		status = conn->readOnce();
+		if(status != CommConnection::READ_DATA) {
+			break;
+		}
+	}
+	bool rearm = true, reconnecting = false;
+	if(status == CommConnection::READ_FULL) {
+		// the user rearms it from notifyConsumed() once it is drained, unless it already was
+		conn->readerWaiting.store(true);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		rearm = conn->buffer.available() <= conn->drainedLevel() && conn->readerWaiting.exchange(false);
+	} else if((status == CommConnection::READ_FAILED && errno != EAGAIN && errno != EWOULDBLOCK) ||
+			(status == CommConnection::READ_NONE && (events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)))) {
+		int error = errno;
+		if(debug) {
+			printf("IoReactor lost a connection. errno = %d\n", error);
+		}
+		if(conn->reconnectsWhenLost()) {
+			// the old socket stops being polled before the reconnect starts, since the new one is registered in its place
+			epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->getFileDescriptor(), NULL);
+			reconnecting = conn->startReconnect(error);
+		}
+		if(!reconnecting) {
+			conn->connected = false;
+			{
+				std::lock_guard<std::mutex> lk(conn->dataMutex);
+				conn->interruptRead = true;
+			}
+			conn->cv.notify_all();
+			conn->fireWatch();
+		}
+		rearm = false;
+	}
+	std::lock_guard<std::mutex> lk(registryMutex);
+	Registration &registration = registrations[conn];
+	if(!registration.removing && !reconnecting && (rearm || registration.rearmRequested)) {
+		arm(conn, EPOLL_CTL_MOD);
+	}
+	registration.busy = false;
+	registration.rearmRequested = false;
+	idleCv.notify_all();
+}
+
+bool IoReactor::arm(CommConnection *conn, const int &op) {
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	event.data.ptr = conn;
+	if(epoll_ctl(epollFd, op, conn->getFileDescriptor(), &event) < 0) {
+		fprintf(stderr, "IoReactor could not poll a connection with errno %d\n", errno);
+		return false;
+	}
+	return true;
+}
+
+// public:
+IoReactor::IoReactor(const int &threadCount, const bool &debug) {
+	this->threadCount = threadCount > 0 ? threadCount : 1;
+	this->debug = debug;
+	interrupt = false;
+	begun = false;
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(epollFd < 0 || wakeFd < 0) {
+		fprintf(stderr, "IoReactor could not be created with errno %d\n", errno);
+		return;
+	}
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+}
+
+bool IoReactor::begin() {
+	if(begun || epollFd < 0 || wakeFd < 0) {
+		return false;
+	}
+	begun = true;
+	for(int i = 0; i < threadCount; i++) {
+		threads.push_back(new std::thread(&IoReactor::run, this));
+	}
+	return true;
+}
+
+void IoReactor::terminate() {
+	interrupt = true;
+	if(wakeFd >= 0) {
+		uint64_t one = 1;
+		if(::write(wakeFd, &one, sizeof(one)) < 0 && debug) {
+			printf("IoReactor could not wake its threads. errno = %d\n", errno);
+		}
+	}
+	for(size_t i = 0; i < threads.size(); i++) {
+		if(threads[i]->joinable()) {
+			threads[i]->join();
+		}
+		delete threads[i];
+	}
+	threads.clear();
+	if(epollFd >= 0) {
+		close(epollFd);
+		epollFd = -1;
+	}
+	if(wakeFd >= 0) {
+		close(wakeFd);
+		wakeFd = -1;
+	}
+}
+
+bool IoReactor::add(CommConnection *conn) {
+	int fd = conn->getFileDescriptor();
+	if(fd < 0 || epollFd < 0) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lk(registryMutex);
+	Registration &registration = registrations[conn];
+	registration.busy = false;
+	registration.rearmRequested = false;
+	registration.removing = false;
+	registration.nonBlocking = (fcntl(fd, F_GETFL) & O_NONBLOCK) != 0;
+	if(!arm(conn, EPOLL_CTL_ADD)) {
+		registrations.erase(conn);
+		return false;
+	}
+	return true;
+}
+
+void IoReactor::remove(CommConnection *conn) {
+	std::unique_lock<std::mutex> lk(registryMutex);
+	std::map<CommConnection *, Registration>::iterator it = registrations.find(conn);
+	if(it == registrations.end()) {
+		return;
+	}
+	it->second.removing = true;
+	if(epollFd >= 0) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->getFileDescriptor(), NULL);
+	}
+	idleCv.wait(lk, [this, conn]{ return !this->registrations[conn].busy; });
+	registrations.erase(conn);
+}
+
+void IoReactor::resume(CommConnection *conn) {
+	std::lock_guard<std::mutex> lk(registryMutex);
+	std::map<CommConnection *, Registration>::iterator it = registrations.find(conn);
+	if(it == registrations.end() || it->second.removing) {
+		return;
+	} else if(it->second.busy) {
+		it->second.rearmRequested = true;
+	} else {
+		arm(conn, EPOLL_CTL_MOD);
+	}
+}
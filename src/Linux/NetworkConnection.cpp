@@ -6,18 +6,51 @@
 #include "../NetworkConnection.h"
 #include <errno.h>
 
+ReconnectOptions::ReconnectOptions(const unsigned int &initialDelay, const double &multiplier, const unsigned int &maxDelay, const double &jitter, const unsigned int &connectTimeout, const unsigned int &maxAttempts) {
+	this->initialDelay = initialDelay;
+	this->multiplier = multiplier;
+	this->maxDelay = maxDelay;
+	this->jitter = jitter;
+	this->connectTimeout = connectTimeout;
+	this->maxAttempts = maxAttempts;
+}
+
 // protected
-bool NetworkConnection::setupServer(const int &port) {
-	bzero((char *) &mAddr, sizeof(struct sockaddr_in));
-	mAddr.sin_family = AF_INET;
-	mAddr.sin_addr.s_addr = htonl(INADDR_ANY);
-	mAddr.sin_port = htons(port);
-	mSocket = socket(mAddr.sin_family, connectionType, 0);
+bool NetworkConnection::setupServer(const int &port, const char *bindAddress) {
+	bzero((char *) &mAddr, sizeof(mAddr));
+	if(strcmp(bindAddress, "") != 0) {
+		std::vector<SocketAddress> addresses;
+		int error = Resolver::resolve(bindAddress, port, connectionType, addresses);
+		if(error != 0) {
+			fprintf(stderr, "Could not resolve %s: %s\n", bindAddress, gai_strerror(error));
+			return false;
+		}
+		mAddr = addresses[0];
+		mSocket = socket(mAddr.sa.sa_family, connectionType, 0);
+	} else {
+		// one IPv6 socket also takes IPv4 clients, which it sees as IPv4 mapped IPv6 addresses
+		mAddr.v6.sin6_family = AF_INET6;
+		mAddr.v6.sin6_addr = in6addr_any;
+		mAddr.v6.sin6_port = htons(port);
+		mSocket = socket(AF_INET6, connectionType, 0);
+		if(mSocket < 0 && errno == EAFNOSUPPORT) {
+			// IPv6 is turned off on this system
+			bzero((char *) &mAddr, sizeof(mAddr));
+			mAddr.v4.sin_family = AF_INET;
+			mAddr.v4.sin_addr.s_addr = htonl(INADDR_ANY);
+			mAddr.v4.sin_port = htons(port);
+			mSocket = socket(AF_INET, connectionType, 0);
+		}
+	}
 	if(mSocket < 0) {
 		fprintf(stderr, "ERROR opening socket: %d\n", errno);
 		return false;
 	}
-	if(bind(mSocket, (struct sockaddr *) &mAddr, sizeof(mAddr)) < 0) {
+	int dualStack = 0;
+	if(mAddr.sa.sa_family == AF_INET6 && setsockopt(mSocket, IPPROTO_IPV6, IPV6_V6ONLY, &dualStack, sizeof(dualStack)) < 0 && debug) {
+		printf("Could not clear IPV6_V6ONLY. errno = %d\n", errno);
+	}
+	if(bind(mSocket, &mAddr.sa, Resolver::length(mAddr)) < 0) {
 		fprintf(stderr, "ERROR on binding to port %d. Is it already taken?\n", port);
 		return false;
 	} 
@@ -34,37 +67,42 @@ bool NetworkConnection::setupServer(const int &port) {
 bool NetworkConnection::waitForClientConnection() {
 	listen(mSocket,5);
 	printf("Waiting for client connection...\n");
-	// accept a client socket
+	// accept a client socket, waiting for one in poll(2) so terminate() can interrupt the wait
 	while(!interruptRead) {
+		if(!waitForReadable(mSocket, blockingTime > 0 ? blockingTime : -1)) {
+			continue;
+		}
 		clientSocket = accept(mSocket, (struct sockaddr *) NULL, NULL);
-		if(errno != EWOULDBLOCK && errno != EAGAIN) {
-			if (clientSocket < 0) {
-				fprintf(stderr, "Accepting a connection failed with errno %d\n", errno);
-				close(mSocket);
-				return false;
-			} else {
-				if(blockingTime >= 0) {
-					fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL) | O_NONBLOCK);
-				}
-				printf("IPv4 client connected!\n");
-				connected = true;
-				return true;
+		if(clientSocket >= 0) {
+			if(blockingTime >= 0) {
+				fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL) | O_NONBLOCK);
 			}
-		} else {
-            std::this_thread::sleep_for(std::chrono::milliseconds(blockingTime));
-        }
+			printf("Client connected!\n");
+			connected = true;
+			return true;
+		} else if(errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+			fprintf(stderr, "Accepting a connection failed with errno %d\n", errno);
+			close(mSocket);
+			return false;
+		}
 	}
 	return false;
 }
 
 bool NetworkConnection::setupClient(const char *ipaddr, const int &port) {
-	struct hostent *server = gethostbyname(ipaddr);
+	host = ipaddr;
+	hostPort = port;
 	bzero((char *) &mAddr, sizeof(mAddr));
 	bzero((char *) &rAddr, sizeof(rAddr));
-	mAddr.sin_family = AF_INET;
-	bcopy((char *)server->h_addr, (char *)&mAddr.sin_addr, server->h_length);
-	mAddr.sin_port = htons(port);
-	mSocket = socket(mAddr.sin_family, connectionType, 0);
+	std::vector<SocketAddress> addresses;
+	int error = Resolver::resolve(host, port, connectionType, addresses);
+	if(error != 0) {
+		// a TCP client resolves the host again each time failedRead() reconnects
+		fprintf(stderr, "Could not resolve %s: %s\n", ipaddr, gai_strerror(error));
+		return false;
+	}
+	mAddr = addresses[0];
+	mSocket = socket(mAddr.sa.sa_family, connectionType, 0);
 	if (mSocket < 0) {
 		fprintf(stderr, "ERROR opening socket: %d\n", errno);
 		return false;
@@ -79,26 +117,155 @@ bool NetworkConnection::setupClient(const char *ipaddr, const int &port) {
 }
 
 bool NetworkConnection::connectToServer() {
-	while(connect(mSocket,(struct sockaddr *) &mAddr,sizeof(mAddr)) < 0 && !interruptRead) {
-		fprintf(stderr, "Couldn't connect to server. Will retry in a second.\n");
-		std::this_thread::sleep_for(std::chrono::seconds(1));
+	double delay = reconnectOptions.initialDelay;
+	for(unsigned int attempt = 1; !interruptRead; attempt++) {
+		reportState(STATE_CONNECTING, attempt, 0);
+		int fd = attemptConnect();
+		if(fd >= 0) {
+			restoreSocketOptions(fd);
+			// the new socket takes over the old one's number, so a writer that is still holding it sends on the new connection
+			if(mSocket < 0) {
+				mSocket = fd;
+			} else if(dup2(fd, mSocket) < 0) {
+				fprintf(stderr, "Could not replace the socket. errno = %d\n", errno);
+				close(fd);
+				return false;
+			} else {
+				close(fd);
+			}
+			printf("Connected to server.\n");
+			connected = true;
+			reportState(STATE_CONNECTED, attempt, 0);
+			return true;
+		}
+		int error = errno;
+		if(interruptRead) {
+			break;
+		}
+		reportState(STATE_DISCONNECTED, attempt, error);
+		if(reconnectOptions.maxAttempts > 0 && attempt >= reconnectOptions.maxAttempts) {
+			fprintf(stderr, "Couldn't connect to server after %u attempts.\n", attempt);
+			reportState(STATE_GAVE_UP, attempt, error);
+			return false;
+		}
+		// some of each wait is random, so clients that lost the same server spread their attempts out
+		double wait = delay*(1-reconnectOptions.jitter*rand_r(&jitterSeed)/RAND_MAX);
+		fprintf(stderr, "Couldn't connect to server. Will retry in %d milliseconds.\n", (int) wait);
+		// waiting on wakeFd lets terminate() cut the wait short
+		if(wakeFd >= 0) {
+			waitForReadable(wakeFd, (int) wait);
+		} else {
+			std::this_thread::sleep_for(std::chrono::milliseconds((int) wait));
+		}
+		delay = delay*reconnectOptions.multiplier < reconnectOptions.maxDelay ? delay*reconnectOptions.multiplier : reconnectOptions.maxDelay;
+	}
+	return false;
+}
+
+int NetworkConnection::attemptConnect() {
+	std::vector<SocketAddress> addresses;
+	int error = Resolver::resolve(host, hostPort, connectionType, addresses);
+	if(error != 0) {
+		if(debug) {
+			printf("Could not resolve %s: %s\n", host.c_str(), gai_strerror(error));
+		}
+		errno = EHOSTUNREACH;
+		return -1;
+	}
+	// the addresses are tried in the order the resolver prefers them, so IPv6 goes first when it is routable
+	for(size_t i = 0; i < addresses.size() && !interruptRead; i++) {
+		int fd = connectTo(addresses[i]);
+		if(fd >= 0) {
+			mAddr = addresses[i];
+			return fd;
+		}
+	}
+	return -1;
+}
+
+int NetworkConnection::connectTo(const SocketAddress &address) {
+	int fd = socket(address.sa.sa_family, connectionType | SOCK_NONBLOCK, 0);
+	if(fd < 0) {
+		return -1;
+	}
+	if(connect(fd, &address.sa, Resolver::length(address)) < 0) {
+		int error = errno;
+		if(error == EINPROGRESS) {
+			// the connect finishes in the background, and is waited for in poll(2) so terminate() can interrupt it
+			socklen_t length = sizeof(error);
+			if(!waitForWritable(fd, reconnectOptions.connectTimeout)) {
+				error = interruptRead ? EINTR : ETIMEDOUT;
+			} else if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) {
+				error = errno;
+			}
+		}
+		if(error != 0) {
+			close(fd);
+			errno = error;
+			return -1;
+		}
+	}
+	if(blockingTime == -1) {
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+	}
+	return fd;
+}
+
+void NetworkConnection::restoreSocketOptions(const int &fd) {
+	int value = 1;
+	if(noDelay && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) < 0 && debug) {
+		printf("Could not set TCP_NODELAY. errno = %d\n", errno);
+	}
+	if(corked && setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) < 0 && debug) {
+		printf("Could not set TCP_CORK. errno = %d\n", errno);
+	}
+	// applyLowLatency() only set it on the first socket
+	if(lowLatency.busyPollMicros > 0 && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &lowLatency.busyPollMicros, sizeof(lowLatency.busyPollMicros)) < 0) {
+		fprintf(stderr, "Could not set SO_BUSY_POLL with error %d\n", errno);
+	}
+	if(zeroCopy) {
+		if(setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) < 0 && debug) {
+			printf("Could not set SO_ZEROCOPY. errno = %d\n", errno);
+		}
+		// the kernel is done with every buffer sent on the old socket, and numbers the new one's sends from 0
+		{
+			std::lock_guard<std::mutex> lk(zeroCopyMutex);
+			zeroCopyDone = zeroCopySends;
+		}
+		reapZeroCopy();
+		std::lock_guard<std::mutex> lk(zeroCopyMutex);
+		zeroCopySends = 0;
+		zeroCopyDone = 0;
+		zeroCopyCopiedRanges.clear();
+	}
+}
+
+void NetworkConnection::reportState(const ConnectionState &state, const unsigned int &attempt, const int &error) {
+	if(stateCallback) {
+		stateCallback(this, state, attempt, error);
 	}
-	printf("Connected to server.\n");
-	connected = true;
-	return true;
 }
 
 void NetworkConnection::failedRead() {
+	int error = errno;
 	if(debug) {
-		printf("Failed to read from socket. errno = %d\n", errno);
+		printf("Failed to read from socket. errno = %d\n", error);
 	}
 	connected = false;
 	if(connectionType == SOCK_STREAM) {
-		if(server && clientSocket > 0) {
+		if(server && mSocket < 0) {
+			// an accepted client has nothing to wait on for another one, so stop reading
+			interruptRead = true;
+		} else if(server && clientSocket > 0) {
 			close(clientSocket);
 			waitForClientConnection();
 		} else {
-			connectToServer();
+			reportState(STATE_DISCONNECTED, 0, error);
+			// the unread data in buffer is kept, so the user picks up where the old connection left off
+			if(!connectToServer()) {
+				std::lock_guard<std::mutex> lk(dataMutex);
+				interruptRead = true;
+			}
 		}
 	}
 }
@@ -119,7 +286,457 @@ int NetworkConnection::getData(char *buff, const int &buffSize) {
 	return -1;
 }
 
+int NetworkConnection::getData(BufferRegion *regions, const int &regionCount) {
+	if(connected && !interruptRead) {
+		struct iovec iov[2];
+		for(int i = 0; i < regionCount; i++) {
+			iov[i].iov_base = regions[i].data;
+			iov[i].iov_len = regions[i].length;
+		}
+		if(datagrams) {
+			return getDatagrams(regions, regionCount);
+		} else if(connectionType == SOCK_STREAM) {
+			int bytesRead;
+			if(zeroCopy) {
+				// completions make the socket poll as having an error, so they are reaped here or the reader would keep waking
+				reapZeroCopy();
+				// the wake up may have been for the completions alone, so the read mustn't wait for data that may not come
+				struct msghdr msg;
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_iov = iov;
+				msg.msg_iovlen = regionCount;
+				bytesRead = recvmsg(server ? clientSocket : mSocket, &msg, MSG_DONTWAIT);
+				if(bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && reactor == NULL && blockingTime < 0) {
+					// a reading thread that blocks takes any failure as the connection being lost
+					return 0;
+				}
+			} else {
+				bytesRead = readv(server ? clientSocket : mSocket, iov, regionCount);
+			}
+			if(bytesRead == 0 && regions[0].length > 0) {
+				// the peer has shut the connection down, so let failedRead() wait for the next client or reconnect
+				errno = ENOTCONN;
+				return -1;
+			}
+			return bytesRead;
+		} else {
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_name = &rAddr;
+			msg.msg_namelen = sizeof(rAddr);
+			msg.msg_iov = iov;
+			msg.msg_iovlen = regionCount;
+			return recvmsg(mSocket, &msg, 0);
+		}
+	}
+	return -1;
+}
+
+int NetworkConnection::getDatagrams(BufferRegion *regions, const int &regionCount) {
+	size_t space = regions[0].length+(regionCount > 1 ? regions[1].length : 0);
+	int count = space/(sizeof(DatagramHeader)+datagramSize);
+	if(count > batchSize) {
+		count = batchSize;
+	} else if(count < 1) {
+		count = 1;
+	}
+	for(int i = 0; i < count; i++) {
+		batchIovs[i].iov_base = &batchData[i*datagramSize];
+		batchIovs[i].iov_len = datagramSize;
+		memset(&batchHeaders[i], 0, sizeof(batchHeaders[i]));
+		batchHeaders[i].msg_hdr.msg_name = &batchAddrs[i];
+		batchHeaders[i].msg_hdr.msg_namelen = sizeof(batchAddrs[i]);
+		batchHeaders[i].msg_hdr.msg_iov = &batchIovs[i];
+		batchHeaders[i].msg_hdr.msg_iovlen = 1;
+	}
+	// only the first datagram may block, the rest of the batch is whatever is already queued
+	int received = recvmmsg(mSocket, &batchHeaders[0], count, MSG_WAITFORONE, NULL);
+	if(received <= 0) {
+		return received;
+	}
+	// copy each datagram in behind its header, splitting it across the regions if it wraps
+	size_t written = 0;
+	for(int i = 0; i < received; i++) {
+		DatagramHeader header;
+		header.length = batchHeaders[i].msg_len;
+		header.source = batchAddrs[i];
+		const char *parts[2] = {(const char *) &header, &batchData[i*datagramSize]};
+		size_t lengths[2] = {sizeof(header), header.length};
+		if(written+lengths[0]+lengths[1] > space) {
+			// doesn't fit, which only happens when the datagrams are being thrown away anyway
+			for(; i < received; i++) {
+				dropped += batchHeaders[i].msg_len;
+			}
+			break;
+		}
+		for(int j = 0; j < 2; j++) {
+			size_t first = written < regions[0].length ? regions[0].length-written : 0;
+			if(first > lengths[j]) {
+				first = lengths[j];
+			}
+			memcpy(regions[0].data+written, parts[j], first);
+			if(first < lengths[j]) {
+				memcpy(regions[1].data+(written+first-regions[0].length), parts[j]+first, lengths[j]-first);
+			}
+			written += lengths[j];
+		}
+	}
+	rAddr = batchAddrs[received-1];
+	return written;
+}
+
+bool NetworkConnection::readDatagram(Datagram &datagram) {
+	DatagramHeader header;
+	while(true) {
+		size_t start = buffer.position();
+		if(!buffer.copyAt(start, (char *) &header, sizeof(header))) {
+			return false;
+		}
+		size_t length = header.length < datagram.capacity ? header.length : datagram.capacity;
+		if(buffer.copyAt(start+sizeof(header), datagram.data, length) && buffer.consumeAt(start, sizeof(header)+header.length)) {
+			datagram.length = length;
+			datagram.source = header.source;
+			return true;
+		} else if(buffer.position() == start) {
+			// nothing was dropped from under the copy, so the datagram just isn't all there
+			return false;
+		}
+	}
+}
+
+bool NetworkConnection::sameShape(const OutgoingDatagram &a, const OutgoingDatagram &b) {
+	if(a.length != b.length) {
+		return false;
+	} else if(a.destination == NULL || b.destination == NULL) {
+		return a.destination == b.destination;
+	}
+	return Resolver::equal(*a.destination, *b.destination);
+}
+
+int NetworkConnection::sendBatch(const OutgoingDatagram *datagrams, const int &count) {
+	struct mmsghdr headers[_SEND_BATCH];
+	struct iovec iovs[_SEND_BATCH];
+	const SocketAddress *peer = server ? &rAddr : &mAddr;
+	int sent = 0;
+	while(sent < count) {
+		int batch = count-sent < _SEND_BATCH ? count-sent : _SEND_BATCH;
+		memset(headers, 0, batch*sizeof(headers[0]));
+		for(int i = 0; i < batch; i++) {
+			const OutgoingDatagram &datagram = datagrams[sent+i];
+			iovs[i].iov_base = (void *) datagram.data;
+			iovs[i].iov_len = datagram.length;
+			const SocketAddress *destination = datagram.destination != NULL ? datagram.destination : peer;
+			headers[i].msg_hdr.msg_name = (void *) destination;
+			headers[i].msg_hdr.msg_namelen = Resolver::length(*destination);
+			headers[i].msg_hdr.msg_iov = &iovs[i];
+			headers[i].msg_hdr.msg_iovlen = 1;
+		}
+		int result = sendmmsg(mSocket, headers, batch, 0);
+		if(result <= 0) {
+			return sent > 0 ? sent : -1;
+		}
+		sent += result;
+	}
+	return sent;
+}
+
+int NetworkConnection::sendSegmented(const OutgoingDatagram *datagrams, const int &count) {
+	struct iovec iovs[_GSO_MAX_SEGMENTS];
+	char control[CMSG_SPACE(sizeof(uint16_t))];
+	for(int i = 0; i < count; i++) {
+		iovs[i].iov_base = (void *) datagrams[i].data;
+		iovs[i].iov_len = datagrams[i].length;
+	}
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	const SocketAddress *destination = &destinationOf(datagrams[0]);
+	msg.msg_name = (void *) destination;
+	msg.msg_namelen = Resolver::length(*destination);
+	msg.msg_iov = iovs;
+	msg.msg_iovlen = count;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	// the kernel cuts the payload back into datagrams of this size
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	uint16_t segmentSize = datagrams[0].length;
+	memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+	if(sendmsg(mSocket, &msg, 0) < 0) {
+		int error = errno;
+		if(error == EAGAIN || error == EWOULDBLOCK) {
+			return -1;
+		}
+		// only the kernel or the device saying it can't segment turns UDP_SEGMENT off. EINVAL also comes from a segment
+		// that doesn't fit a path MTU that shrank, and other errors, like one queued by an ICMP message, are about the
+		// path, so then only these datagrams are sent one by one
+		bool unsupported = error == EIO || error == ENOPROTOOPT || error == EOPNOTSUPP
+			|| (error == EINVAL && segmentSize <= segmentLimit(*destination, true));
+		if(debug) {
+			printf("UDP_SEGMENT failed with errno %d, falling back to sendmmsg%s\n", error, unsupported ? " from now on" : "");
+		}
+		if(unsupported) {
+			gsoUnsupported = true;
+		}
+		return sendBatch(datagrams, count);
+	}
+	return count;
+}
+
+const SocketAddress &NetworkConnection::destinationOf(const OutgoingDatagram &datagram) const {
+	return datagram.destination != NULL ? *datagram.destination : (server ? rAddr : mAddr);
+}
+
+size_t NetworkConnection::segmentLimit(const SocketAddress &destination, const bool &refresh) {
+	if(mtuKnown && !refresh && Resolver::equal(destination, mtuDestination)) {
+		return mtuLimit;
+	}
+	bool v6 = destination.sa.sa_family == AF_INET6;
+	size_t limit = _GSO_DEFAULT_SEGMENT;
+	// connecting a UDP socket sends nothing, but gives it a route to read the path MTU from
+	int fd = socket(destination.sa.sa_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if(fd >= 0) {
+		int mtu;
+		socklen_t length = sizeof(mtu);
+		if(connect(fd, &destination.sa, Resolver::length(destination)) == 0
+			&& getsockopt(fd, v6 ? IPPROTO_IPV6 : IPPROTO_IP, v6 ? IPV6_MTU : IP_MTU, &mtu, &length) == 0) {
+			// the IP and UDP headers. An IPv4 mapped destination is counted as IPv6, which only makes the limit smaller
+			size_t headers = (v6 ? 40 : 20)+8;
+			limit = (size_t) mtu > headers ? mtu-headers : 0;
+		}
+		close(fd);
+	}
+	mtuDestination = destination;
+	mtuLimit = limit;
+	mtuKnown = true;
+	return limit;
+}
+
+bool NetworkConnection::canSegment(const OutgoingDatagram &datagram) {
+	return !gsoUnsupported && datagram.length <= segmentLimit(destinationOf(datagram));
+}
+
+void NetworkConnection::setReadThreshold(const int &bytes) {
+	if(connectionType == SOCK_STREAM && setsockopt(getFileDescriptor(), SOL_SOCKET, SO_RCVLOWAT, &bytes, sizeof(bytes)) < 0 && debug) {
+		printf("Could not set SO_RCVLOWAT. errno = %d\n", errno);
+	}
+}
+
+bool NetworkConnection::readsInPlace() const {
+	return connectionType == SOCK_STREAM && !datagrams;
+}
+
+bool NetworkConnection::reconnectsWhenLost() const {
+	return connectionType == SOCK_STREAM && !server;
+}
+
+int NetworkConnection::getFileDescriptor() const {
+	if(connectionType == SOCK_STREAM && server) {
+		return clientSocket;
+	}
+	return mSocket;
+}
+
+ssize_t NetworkConnection::sendAll(struct iovec *iov, int count, const int &flags) {
+	int fd = getFileDescriptor();
+	ssize_t sent = 0;
+	struct msghdr message;
+	bzero((char *) &message, sizeof(message));
+	while(count > 0) {
+		if(iov->iov_len == 0) {
+			iov++;
+			count--;
+			continue;
+		}
+		message.msg_iov = iov;
+		message.msg_iovlen = count;
+		// the socket is waited on in poll(2) rather than in the send so closeThread() can wake it,
+		// and a peer that has gone away fails the send instead of raising SIGPIPE
+		ssize_t result = sendmsg(fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL | flags);
+		if(result < 0) {
+			// zero copy sends are limited by how much completion state the socket can hold, so reaping makes room
+			if((flags & MSG_ZEROCOPY) && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) && reapZeroCopy() > 0) {
+				continue;
+			}
+			if(errno == EINTR || ((errno == EAGAIN || errno == EWOULDBLOCK) && waitForWritable(fd, -1))) {
+				continue;
+			}
+			return sent > 0 ? sent : -1;
+		}
+		if(flags & MSG_ZEROCOPY) {
+			zeroCopySends++;
+		}
+		sent += result;
+		// a partial send leaves the first unsent buffer pointing at what is left of it
+		while(result > 0) {
+			size_t part = (size_t) result < iov->iov_len ? (size_t) result : iov->iov_len;
+			iov->iov_base = (char *) iov->iov_base+part;
+			iov->iov_len -= part;
+			result -= part;
+			if(iov->iov_len == 0) {
+				iov++;
+				count--;
+			}
+		}
+	}
+	return sent;
+}
+
+bool NetworkConnection::queueWrite(std::unique_lock<std::mutex> &lk, const char *buff, const int &buffSize) {
+	size_t start = outbound.writePosition();
+	size_t queued = 0;
+	while(queued < (size_t) buffSize) {
+		if(!connected || interruptRead) {
+			return false;
+		} else if(stopWriting) {
+			// setWriteMode(2) is sending what was queued, so wait to see how the rest goes out
+			writeCv.wait(lk, [this]() { return !stopWriting || !connected || interruptRead; });
+			start = outbound.writePosition();
+			continue;
+		} else if(writeMode == WRITE_DIRECT) {
+			// what was queued before has been sent, so the rest follows it straight away
+			struct iovec iov;
+			iov.iov_base = (void *) &buff[queued];
+			iov.iov_len = buffSize-queued;
+			return sendAll(&iov, 1) == (ssize_t) (buffSize-queued);
+		}
+		if(writeThread == NULL) {
+			writing = true;
+			writeThread = new std::thread(&NetworkConnection::performWrites, this);
+		}
+		queued += outbound.write(&buff[queued], buffSize-queued);
+		writeCv.notify_all();
+		if(queued < (size_t) buffSize) {
+			writeCv.wait(lk, [this]() { return outbound.freeSpace() > 0 || !writing; });
+		}
+	}
+	if(writeMode == WRITE_FLUSHED) {
+		size_t end = outbound.writePosition();
+		writeCv.wait(lk, [this, end]() { return outbound.position() >= end || !writing; });
+		// writeThread only stops once it has sent everything queued, even if setWriteMode(2) then emptied outbound
+		return (outbound.position() >= end || !writing) && discardedTo <= start;
+	}
+	return true;
+}
+
+void NetworkConnection::performWrites() {
+	std::unique_lock<std::mutex> lk(writeMutex);
+	while(true) {
+		writeCv.wait(lk, [this]() { return stopWriting || outbound.available() > 0; });
+		if(outbound.available() == 0) {
+			break;
+		}
+		lk.unlock();
+		// everything that was queued while the last send went out is sent together
+		BufferSpan spans[2];
+		struct iovec iov[2];
+		int count = outbound.peek(spans);
+		size_t length = 0;
+		for(int i = 0; i < count; i++) {
+			iov[i].iov_base = (void *) spans[i].data;
+			iov[i].iov_len = spans[i].length;
+			length += spans[i].length;
+		}
+		ssize_t sent = sendAll(iov, count);
+		lk.lock();
+		if(sent > 0) {
+			outbound.consume(sent);
+		}
+		if(sent < (ssize_t) length) {
+			if(debug) {
+				printf("Could not send %lu queued bytes. errno = %d\n", (unsigned long) outbound.available(), errno);
+			}
+			// the rest can't be sent in order anymore, so it is thrown away for flush(1) to report
+			outbound.clear();
+			discardedTo = outbound.position();
+		}
+		writeCv.notify_all();
+	}
+	writing = false;
+	writeCv.notify_all();
+}
+
+void NetworkConnection::stopWriter() {
+	std::thread *thread;
+	{
+		std::lock_guard<std::mutex> lk(writeMutex);
+		stopWriting = true;
+		thread = writeThread;
+	}
+	writeCv.notify_all();
+	if(thread != NULL && thread->joinable()) {
+		thread->join();
+	}
+	std::lock_guard<std::mutex> lk(writeMutex);
+	delete thread;
+	writeThread = NULL;
+}
+
+bool NetworkConnection::zeroCopyOverlaps(const ZeroCopyBuffer &buffer, const uint32_t &first, const uint32_t &last) {
+	// compared by difference, since the numbers wrap around
+	return (int32_t) (last-buffer.start) >= 0 && (int32_t) (buffer.end-first) > 0;
+}
+
+int NetworkConnection::reapZeroCopy() {
+	std::vector<ZeroCopyBuffer> retired;
+	{
+		std::lock_guard<std::mutex> lk(zeroCopyMutex);
+		char control[CMSG_SPACE(sizeof(struct sock_extended_err))+CMSG_SPACE(sizeof(SocketAddress))];
+		struct msghdr message;
+		bzero((char *) &message, sizeof(message));
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		while(recvmsg(getFileDescriptor(), &message, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0) {
+			for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+				// IPv6 sockets report completions at their own level, even for IPv4 mapped peers
+				if((cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) && (cmsg->cmsg_level != SOL_IPV6 || cmsg->cmsg_type != IPV6_RECVERR)) {
+					continue;
+				}
+				struct sock_extended_err *error = (struct sock_extended_err *) CMSG_DATA(cmsg);
+				if(error->ee_origin != SO_EE_ORIGIN_ZEROCOPY || error->ee_errno != 0) {
+					continue;
+				}
+				// each completion covers the sends numbered ee_info to ee_data, and TCP completes them in order
+				uint32_t done = error->ee_data+1;
+				if((int32_t) (done-zeroCopyDone) > 0) {
+					zeroCopyDone = done;
+				}
+				if((error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) == 0) {
+					continue;
+				}
+				// only the buffers the completion covers were copied. Sends that are newer than every buffer belong to
+				// one writeZeroCopy(2) hasn't added yet, so they are kept for it to pick up
+				for(size_t i = 0; i < zeroCopyPending.size(); i++) {
+					if(zeroCopyOverlaps(zeroCopyPending[i], error->ee_info, error->ee_data)) {
+						zeroCopyPending[i].copied = true;
+					}
+				}
+				if(zeroCopyPending.empty() || (int32_t) (error->ee_data-zeroCopyPending.back().end) >= 0) {
+					zeroCopyCopiedRanges.push_back(std::make_pair(error->ee_info, error->ee_data));
+				}
+			}
+			message.msg_controllen = sizeof(control);
+		}
+		// a buffer may have been finished before writeZeroCopy(2) added it, so this runs even without new completions
+		while(!zeroCopyPending.empty() && (int32_t) (zeroCopyDone-zeroCopyPending.front().end) >= 0) {
+			retired.push_back(zeroCopyPending.front());
+			zeroCopyPending.pop_front();
+			zeroCopyRetired++;
+		}
+	}
+	if(zeroCopyCallback) {
+		for(size_t i = 0; i < retired.size(); i++) {
+			zeroCopyCallback(retired[i].id, retired[i].copied);
+		}
+	}
+	return retired.size();
+}
+
 void NetworkConnection::exitGracefully() {
+	// send what is left in the write queue, as far as the socket takes it without waiting
+	stopWriter();
 	// shutdown the send half of the connection since no more data will be sent
 	// cleanup
 	if(clientSocket > 0)
@@ -141,10 +758,53 @@ bool NetworkConnection::setBlocking(const int &blockingTime) {
 }
 
 // public 
+NetworkConnection::NetworkConnection(const int &clientSocket, const SocketAddress &clientAddr, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : CommConnection(blockingTime, debug, noReads, bufferOptions) {
+	connectionType = SOCK_STREAM;
+	server = true;
+	datagrams = false;
+	batchSize = _DATAGRAM_BATCH;
+	datagramSize = _DATAGRAM_SIZE;
+	gsoUnsupported = false;
+	mtuLimit = 0;
+	mtuKnown = false;
+	writeMode = WRITE_DIRECT;
+	writeThread = NULL;
+	stopWriting = false;
+	writing = false;
+	discardedTo = 0;
+	flushedTo = 0;
+	zeroCopy = false;
+	zeroCopySends = 0;
+	zeroCopyDone = 0;
+	zeroCopyBuffers = 0;
+	zeroCopyRetired = 0;
+	noDelay = false;
+	corked = false;
+	jitterSeed = time(NULL) ^ (uintptr_t) this;
+	hostPort = 0;
+	mSocket = -1;
+	this->clientSocket = clientSocket;
+	bzero((char *) &mAddr, sizeof(mAddr));
+	rAddr = clientAddr;
+	connected = clientSocket >= 0;
+}
+
 NetworkConnection::NetworkConnection(const NetworkConnection &other) : CommConnection(other) {
     if(this == &other) {
         return;
     }
+    // the copy starts its own writeThread when it first queues a write
+    writeThread = NULL;
+    stopWriting = false;
+    writing = false;
+    discardedTo = 0;
+    flushedTo = 0;
+    zeroCopy = false;
+    zeroCopySends = 0;
+    zeroCopyDone = 0;
+    zeroCopyBuffers = 0;
+    zeroCopyRetired = 0;
+    jitterSeed = time(NULL) ^ (uintptr_t) this;
     *this = other;
 }
 
@@ -156,25 +816,270 @@ NetworkConnection &NetworkConnection::operator=(const NetworkConnection &other)
     clientSocket = other.clientSocket;
     mAddr = other.mAddr;
     rAddr = other.rAddr;
+    host = other.host;
+    hostPort = other.hostPort;
+    datagrams = other.datagrams;
+    batchSize = other.batchSize;
+    datagramSize = other.datagramSize;
+    batchData = other.batchData;
+    batchHeaders = other.batchHeaders;
+    batchIovs = other.batchIovs;
+    batchAddrs = other.batchAddrs;
+    gsoUnsupported = other.gsoUnsupported;
+    mtuDestination = other.mtuDestination;
+    mtuLimit = other.mtuLimit;
+    mtuKnown = other.mtuKnown;
+    writeMode = other.writeMode;
+    // what other has queued is other's to send, so only the size of its queue is copied
+    outbound.reset(other.outbound.getOptions());
+    if(writeMode != WRITE_DIRECT) {
+        outbound.allocate();
+    }
+    zeroCopy = other.zeroCopy;
+    zeroCopyCallback = other.zeroCopyCallback;
+    reconnectOptions = other.reconnectOptions;
+    stateCallback = other.stateCallback;
+    noDelay = other.noDelay;
+    corked = other.corked;
     CommConnection::operator=(other);
     return *this;
 }
 
-bool NetworkConnection::write(const char *buff, const int &buffSize) {
-	if(!connected) 
+bool NetworkConnection::useDatagrams(const bool &datagrams, const int &batchSize, const int &datagramSize) {
+	if(begun || connectionType != SOCK_DGRAM || batchSize < 1 || datagramSize < 1 || datagramSize > _MAX_DATAGRAM_SIZE) {
 		return false;
-	int *socket;
-	sockaddr_in *addr;
-	if(server) {
-		socket = &clientSocket;
-		addr = &rAddr;
+	}
+	this->datagrams = datagrams;
+	this->batchSize = batchSize;
+	this->datagramSize = datagramSize;
+	if(datagrams) {
+		batchData.resize(batchSize*datagramSize);
+		batchHeaders.resize(batchSize);
+		batchIovs.resize(batchSize);
+		batchAddrs.resize(batchSize);
+		readReserve = sizeof(DatagramHeader)+datagramSize;
 	} else {
-		socket = &mSocket;
-		addr = &mAddr;
+		readReserve = 0;
 	}
+	return true;
+}
+
+int NetworkConnection::writeDatagrams(const std::vector<OutgoingDatagram> &datagrams) {
+	if(!connected || connectionType != SOCK_DGRAM) {
+		return -1;
+	}
+	int count = datagrams.size();
+	int sent = 0;
+	while(sent < count) {
+		// find how many datagrams from here on can be one segmented send
+		int run = 1;
+		if(sent+1 < count && sameShape(datagrams[sent], datagrams[sent+1]) && canSegment(datagrams[sent])) {
+			const OutgoingDatagram &first = datagrams[sent];
+			size_t maxRun = first.length > 0 ? _MAX_DATAGRAM_SIZE/first.length : 1;
+			if(maxRun > _GSO_MAX_SEGMENTS) {
+				maxRun = _GSO_MAX_SEGMENTS;
+			}
+			while(sent+run < count && (size_t) run < maxRun && sameShape(datagrams[sent+run], first)) {
+				run++;
+			}
+		}
+		int result;
+		if(run > 1) {
+			result = sendSegmented(&datagrams[sent], run);
+		} else {
+			// send everything up to the next run that can be segmented as one batch
+			int end = sent+1;
+			while(end < count && (end+1 == count || !sameShape(datagrams[end], datagrams[end+1]) || !canSegment(datagrams[end]))) {
+				end++;
+			}
+			run = end-sent;
+			result = sendBatch(&datagrams[sent], run);
+		}
+		if(result < 0) {
+			return sent > 0 ? sent : -1;
+		}
+		sent += result;
+		if(result < run) {
+			break;
+		}
+	}
+	return sent;
+}
+
+int NetworkConnection::readDatagram(char *buff, const int &buffSize, SocketAddress *source) {
+	Datagram datagram;
+	datagram.data = buff;
+	datagram.capacity = buffSize;
+	if(readDatagrams(&datagram, 1) == 0) {
+		return -1;
+	}
+	if(source != NULL) {
+		*source = datagram.source;
+	}
+	return datagram.length;
+}
+
+int NetworkConnection::readDatagrams(Datagram *datagrams, const int &count) {
+	int filled = 0;
+	while(filled < count && readDatagram(datagrams[filled])) {
+		filled++;
+	}
+	if(filled > 0) {
+		notifyConsumed();
+	}
+	return filled;
+}
+
+bool NetworkConnection::setWriteMode(const WriteMode &mode, const size_t &queueSize) {
+	if(connectionType != SOCK_STREAM) {
+		return mode == WRITE_DIRECT;
+	}
+	// anything queued under the old mode goes out first
+	stopWriter();
+	std::lock_guard<std::mutex> lk(writeMutex);
+	writeMode = mode;
+	discardedTo = 0;
+	flushedTo = 0;
+	bool allocated = true;
+	if(mode == WRITE_DIRECT) {
+		outbound.reset(BufferOptions());
+	} else {
+		outbound.reset(BufferOptions(queueSize));
+		allocated = outbound.allocate();
+		if(!allocated) {
+			fprintf(stderr, "Could not allocate a write queue of %lu bytes\n", (unsigned long) queueSize);
+			writeMode = WRITE_DIRECT;
+		}
+	}
+	// the writes waiting in queueWrite(3) go on in whichever mode was chosen
+	stopWriting = false;
+	writeCv.notify_all();
+	return allocated;
+}
+
+bool NetworkConnection::flush(const int &timeout) {
+	std::unique_lock<std::mutex> lk(writeMutex);
+	size_t end = outbound.writePosition();
+	auto sent = [this, end]() { return outbound.position() >= end || !writing; };
+	if(timeout < 0) {
+		writeCv.wait(lk, sent);
+	} else if(!writeCv.wait_for(lk, std::chrono::milliseconds(timeout), sent)) {
+		return false;
+	}
+	bool succeeded = outbound.position() >= end && discardedTo <= flushedTo;
+	flushedTo = end;
+	return succeeded;
+}
+
+bool NetworkConnection::setNoDelay(const bool &noDelay) {
+	int value = noDelay;
+	if(connectionType != SOCK_STREAM || setsockopt(getFileDescriptor(), IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) < 0) {
+		if(debug) {
+			printf("Could not set TCP_NODELAY. errno = %d\n", errno);
+		}
+		return false;
+	}
+	this->noDelay = noDelay;
+	return true;
+}
+
+bool NetworkConnection::setCork(const bool &cork) {
+	int value = cork;
+	if(connectionType != SOCK_STREAM || setsockopt(getFileDescriptor(), IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) < 0) {
+		if(debug) {
+			printf("Could not set TCP_CORK. errno = %d\n", errno);
+		}
+		return false;
+	}
+	corked = cork;
+	return true;
+}
+
+bool NetworkConnection::useZeroCopy(const bool &zeroCopy, const ZeroCopyCallback &callback) {
+	int value = zeroCopy;
+	if(connectionType != SOCK_STREAM || setsockopt(getFileDescriptor(), SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) < 0) {
+		if(debug) {
+			printf("Could not set SO_ZEROCOPY. errno = %d\n", errno);
+		}
+		return false;
+	}
+	std::lock_guard<std::mutex> lk(zeroCopyMutex);
+	this->zeroCopy = zeroCopy;
+	zeroCopyCallback = callback;
+	return true;
+}
+
+long long NetworkConnection::writeZeroCopy(const char *buff, const size_t &length) {
+	if(!connected || !zeroCopy) {
+		return -1;
+	}
+	ssize_t sent;
+	long long id = -1;
+	{
+		std::lock_guard<std::mutex> lk(writeMutex);
+		if(writeMode != WRITE_DIRECT || stopWriting) {
+			return -1;
+		}
+		struct iovec iov;
+		iov.iov_base = (void *) buff;
+		iov.iov_len = length;
+		uint32_t start = zeroCopySends;
+		sent = sendAll(&iov, 1, MSG_ZEROCOPY);
+		if(sent > 0) {
+			std::lock_guard<std::mutex> zk(zeroCopyMutex);
+			ZeroCopyBuffer buffer;
+			buffer.id = zeroCopyBuffers++;
+			buffer.start = start;
+			buffer.end = zeroCopySends;
+			buffer.copied = false;
+			// picks up the copies the kernel reported before the buffer was added, and forgets the ones no later buffer has
+			for(size_t i = 0; i < zeroCopyCopiedRanges.size(); i++) {
+				if(zeroCopyOverlaps(buffer, zeroCopyCopiedRanges[i].first, zeroCopyCopiedRanges[i].second)) {
+					buffer.copied = true;
+				}
+			}
+			while(!zeroCopyCopiedRanges.empty() && (int32_t) (buffer.end-1-zeroCopyCopiedRanges.front().second) >= 0) {
+				zeroCopyCopiedRanges.pop_front();
+			}
+			zeroCopyPending.push_back(buffer);
+			id = buffer.id;
+		}
+	}
+	reapZeroCopy();
+	return sent == (ssize_t) length ? id : -1;
+}
+
+unsigned long long NetworkConnection::zeroCopyCompleted() {
+	reapZeroCopy();
+	std::lock_guard<std::mutex> lk(zeroCopyMutex);
+	return zeroCopyRetired;
+}
+
+bool NetworkConnection::setReconnect(const ReconnectOptions &options, const ConnectionStateCallback &callback) {
+	if(connectionType != SOCK_STREAM || server) {
+		return false;
+	}
+	reconnectOptions = options;
+	stateCallback = callback;
+	return true;
+}
+
+bool NetworkConnection::write(const char *buff, const int &buffSize) {
+	if(!connected) 
+		return false;
     if(connectionType == SOCK_STREAM) {
-        return send(*socket, buff, buffSize, 0);
-    } else {
-    	return sendto(*socket, buff, buffSize, 0, (sockaddr *) addr, (socklen_t) sizeof(*addr)) >= 0;
+        // keeps writes from several threads from interleaving when one of them is only partly sent
+        // and keeps setWriteMode(2) from changing the mode under a write
+        std::unique_lock<std::mutex> lk(writeMutex);
+        if(writeMode != WRITE_DIRECT) {
+            return queueWrite(lk, buff, buffSize);
+        }
+        struct iovec iov;
+        iov.iov_base = (void *) buff;
+        iov.iov_len = buffSize;
+        return sendAll(&iov, 1) == buffSize;
     }
+	// a UDP server answers whoever it last heard from, from the socket it is bound to
+	const SocketAddress *addr = server ? &rAddr : &mAddr;
+	return sendto(mSocket, buff, buffSize, 0, &addr->sa, Resolver::length(*addr)) >= 0;
 }
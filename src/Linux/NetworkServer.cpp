@@ -0,0 +1,167 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "../NetworkServer.h"
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+
+// protected:
+int NetworkServer::openListener() {
+	SocketAddress addr;
+	bzero((char *) &addr, sizeof(addr));
+	int sock;
+	if(!bindAddress.empty()) {
+		std::vector<SocketAddress> addresses;
+		int error = Resolver::resolve(bindAddress, port, SOCK_STREAM, addresses);
+		if(error != 0) {
+			fprintf(stderr, "Could not resolve %s: %s\n", bindAddress.c_str(), gai_strerror(error));
+			return -1;
+		}
+		addr = addresses[0];
+		sock = socket(addr.sa.sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	} else {
+		// one IPv6 socket also takes IPv4 clients, which it sees as IPv4 mapped IPv6 addresses
+		addr.v6.sin6_family = AF_INET6;
+		addr.v6.sin6_addr = in6addr_any;
+		addr.v6.sin6_port = htons(port);
+		sock = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(sock < 0 && errno == EAFNOSUPPORT) {
+			// IPv6 is turned off on this system
+			bzero((char *) &addr, sizeof(addr));
+			addr.v4.sin_family = AF_INET;
+			addr.v4.sin_addr.s_addr = htonl(INADDR_ANY);
+			addr.v4.sin_port = htons(port);
+			sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		}
+	}
+	if(sock < 0) {
+		fprintf(stderr, "ERROR opening socket: %d\n", errno);
+		return -1;
+	}
+	int enable = 1;
+	int dualStack = 0;
+	if(addr.sa.sa_family == AF_INET6 && setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &dualStack, sizeof(dualStack)) < 0 && debug) {
+		printf("Could not clear IPV6_V6ONLY. errno = %d\n", errno);
+	}
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	if(setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+		fprintf(stderr, "Could not set SO_REUSEPORT with error %d\n", errno);
+		close(sock);
+		return -1;
+	}
+	if(bind(sock, &addr.sa, Resolver::length(addr)) < 0) {
+		fprintf(stderr, "ERROR on binding to port %d. Is it already taken?\n", port);
+		close(sock);
+		return -1;
+	}
+	if(listen(sock, SOMAXCONN) < 0) {
+		fprintf(stderr, "ERROR listening on port %d: %d\n", port, errno);
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+void NetworkServer::performAccepts(const int &index) {
+	if(pinned) {
+		unsigned int cores = std::thread::hardware_concurrency();
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(index % (cores > 0 ? cores : 1), &cpus);
+		if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0 && debug) {
+			printf("Could not pin acceptor %d to a core\n", index);
+		}
+	}
+	// accepted sockets only block when the connection is meant to, same as waitForClientConnection()
+	int flags = SOCK_CLOEXEC | (blockingTime >= 0 ? SOCK_NONBLOCK : 0);
+	struct pollfd fds[2];
+	fds[0].fd = listenSockets[index];
+	fds[0].events = POLLIN;
+	fds[1].fd = wakeFd;
+	fds[1].events = POLLIN;
+	while(!interruptAccept) {
+		if(poll(fds, 2, -1) < 0 && errno != EINTR) {
+			fprintf(stderr, "Polling for clients failed with errno %d\n", errno);
+			return;
+		}
+		while(!interruptAccept) {
+			SocketAddress clientAddr;
+			socklen_t len = sizeof(clientAddr);
+			int clientSocket = accept4(listenSockets[index], (struct sockaddr *) &clientAddr, &len, flags);
+			if(clientSocket < 0) {
+				if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+					fprintf(stderr, "Accepting a connection failed with errno %d\n", errno);
+				}
+				break;
+			}
+			if(debug) {
+				printf("Client connected to acceptor %d!\n", index);
+			}
+			deliver(new NetworkConnection(clientSocket, clientAddr, blockingTime, debug, noReads, bufferOptions));
+		}
+	}
+}
+
+// public:
+bool NetworkServer::begin() {
+	if(begun) {
+		return false;
+	}
+	wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(wakeFd < 0) {
+		fprintf(stderr, "Could not create an eventfd with errno %d\n", errno);
+		return false;
+	}
+	for(int i = 0; i < acceptorCount; i++) {
+		int sock = openListener();
+		if(sock < 0) {
+			terminate();
+			return false;
+		}
+		listenSockets.push_back(sock);
+	}
+	begun = true;
+	for(int i = 0; i < acceptorCount; i++) {
+		acceptors.push_back(new std::thread(&NetworkServer::performAccepts, this, i));
+	}
+	printf("Successfully setup socket server.\n");
+	return true;
+}
+
+void NetworkServer::terminate() {
+	{
+		std::lock_guard<std::mutex> lk(sessionMutex);
+		interruptAccept = true;
+	}
+	sessionCv.notify_all();
+	if(wakeFd >= 0) {
+		uint64_t one = 1;
+		if(::write(wakeFd, &one, sizeof(one)) < 0 && debug) {
+			printf("Could not wake the acceptors. errno = %d\n", errno);
+		}
+	}
+	for(size_t i = 0; i < acceptors.size(); i++) {
+		if(acceptors[i]->joinable()) {
+			acceptors[i]->join();
+		}
+		delete acceptors[i];
+	}
+	acceptors.clear();
+	for(size_t i = 0; i < listenSockets.size(); i++) {
+		close(listenSockets[i]);
+	}
+	listenSockets.clear();
+	if(wakeFd >= 0) {
+		close(wakeFd);
+		wakeFd = -1;
+	}
+	std::lock_guard<std::mutex> lk(sessionMutex);
+	while(!sessions.empty()) {
+		delete sessions.front();
+		sessions.pop_front();
+	}
+}
@@ -5,6 +5,26 @@
 */
 #include "../SerialConnection.h"
 
+#ifndef BOTHER
+	#define BOTHER 0010000
+#endif
+#ifndef IBSHIFT
+	#define IBSHIFT 16
+#endif
+
+// the kernel's struct termios2 from <asm/termbits.h>, which can't be included alongside <termios.h>
+// TCGETS2 and TCSETS2 take it, and with BOTHER its speeds can be any number rather than a B constant
+struct termios2 {
+	tcflag_t c_iflag;
+	tcflag_t c_oflag;
+	tcflag_t c_cflag;
+	tcflag_t c_lflag;
+	cc_t c_line;
+	cc_t c_cc[19];
+	speed_t c_ispeed;
+	speed_t c_ospeed;
+};
+
 // protected:
 void SerialConnection::failedRead() {
 	fprintf(stderr, "Failed to read from serial port with error: %d\n", errno);
@@ -17,6 +37,21 @@ int SerialConnection::getData(char *buff, const int &buffSize) {
 	return ::read(ser, buff, buffSize);
 }
 
+int SerialConnection::getData(BufferRegion *regions, const int &regionCount) {
+	if(!connected)
+		return -1; 
+	struct iovec iov[2];
+	for(int i = 0; i < regionCount; i++) {
+		iov[i].iov_base = regions[i].data;
+		iov[i].iov_len = regions[i].length;
+	}
+	return readv(ser, iov, regionCount);
+}
+
+int SerialConnection::getFileDescriptor() const {
+	return ser;
+}
+
 void SerialConnection::exitGracefully() {
 	if (connected && ser > 0) {
 		connected = false;
@@ -25,7 +60,7 @@ void SerialConnection::exitGracefully() {
 }
 
 // taken from https://stackoverflow.com/questions/6947413/how-to-open-read-and-write-from-serial-port-in-c
-int SerialConnection::set_interface_attribs (const int &speed, const int &parity) {
+int SerialConnection::set_interface_attribs (const int &speed, const int &parity, const int &minBytes, const int &interByteTimeout) {
 	struct termios tty;
 	memset (&tty, 0, sizeof tty);
 	if (tcgetattr (ser, &tty) != 0) {
@@ -33,8 +68,10 @@ int SerialConnection::set_interface_attribs (const int &speed, const int &parity
 		return -1;
 	}
 
-	cfsetospeed (&tty, speed);
-	cfsetispeed (&tty, speed);
+	if (speed != -1) {
+		cfsetospeed (&tty, speed);
+		cfsetispeed (&tty, speed);
+	}
 
 	tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;     // 8-bit chars
 	// disable IGNBRK for mismatched speed tests; otherwise receive break
@@ -43,10 +80,11 @@ int SerialConnection::set_interface_attribs (const int &speed, const int &parity
 	tty.c_lflag = 0;                // no signaling chars, no echo,
 	                                // no canonical processing
 	tty.c_oflag = 0;                // no remapping, no delays
-	tty.c_cc[VMIN]  = 0;            // read doesn't block
-	tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
+	tty.c_cc[VMIN]  = minBytes;     // how many bytes a read waits for
+	tty.c_cc[VTIME] = interByteTimeout; // in tenths of a second
 
 	tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
+	tty.c_iflag &= ~(ICRNL | INLCR | IGNCR | ISTRIP); // pass CR, NL and the 8th bit through untouched
 
 	tty.c_cflag |= (CLOCAL | CREAD);// ignore modem controls,
 	                                // enable reading
@@ -62,6 +100,48 @@ int SerialConnection::set_interface_attribs (const int &speed, const int &parity
 	return 0;
 }
 
+bool SerialConnection::setBaudRate(const unsigned int &baudRate) {
+	struct termios2 tio;
+	if (ioctl(ser, TCGETS2, &tio) < 0) {
+		fprintf(stderr, "error %d from TCGETS2\n", errno);
+		return false;
+	}
+	// the input speed follows the output speed
+	tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+	tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+	tio.c_ispeed = baudRate;
+	tio.c_ospeed = baudRate;
+	if (ioctl(ser, TCSETS2, &tio) < 0) {
+		fprintf(stderr, "error %d setting the speed to %u\n", errno, baudRate);
+		return false;
+	}
+	// the driver picks the closest rate its clock can divide down to, which may be too far off for the other end
+	if (ioctl(ser, TCGETS2, &tio) == 0 && (tio.c_ospeed < baudRate*0.97 || tio.c_ospeed > baudRate*1.03)) {
+		fprintf(stderr, "The port runs at %u baud instead of %u\n", tio.c_ospeed, baudRate);
+	}
+	return true;
+}
+
+bool SerialConnection::setLowLatencyMode(const bool &lowLatency) {
+	struct serial_struct serial;
+	if (ioctl(ser, TIOCGSERIAL, &serial) < 0) {
+		if (debug) {
+			printf("The port has no serial settings for ASYNC_LOW_LATENCY. errno = %d\n", errno);
+		}
+		return false;
+	}
+	if (lowLatency) {
+		serial.flags |= ASYNC_LOW_LATENCY;
+	} else {
+		serial.flags &= ~ASYNC_LOW_LATENCY;
+	}
+	if (ioctl(ser, TIOCSSERIAL, &serial) < 0) {
+		fprintf(stderr, "error %d setting ASYNC_LOW_LATENCY\n", errno);
+		return false;
+	}
+	return true;
+}
+
 // adapted from https://stackoverflow.com/questions/6947413/how-to-open-read-and-write-from-serial-port-in-c
 bool SerialConnection::setBlocking(const int &blockingTime) {
 	if(blockingTime == -1) {
@@ -87,7 +167,7 @@ bool SerialConnection::setBlocking(const int &blockingTime) {
 // public:
 // speed should have a B in front of it (ie. B57600)
 // I recommend parity 0
-SerialConnection::SerialConnection(const char *portName, const int &speed, const int &parity, const int &blockingTime, const bool &debug, const bool &noReads) : CommConnection(blockingTime, debug, noReads) {
+SerialConnection::SerialConnection(const char *portName, const int &speed, const int &parity, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : CommConnection(blockingTime, debug, noReads, bufferOptions) {
 	connected = false;
 	ser = open (portName, O_RDWR | O_NOCTTY | O_SYNC);
 	if (ser < 0) {
@@ -101,6 +181,26 @@ SerialConnection::SerialConnection(const char *portName, const int &speed, const
 	connected = true;
 }
 
+SerialConnection::SerialConnection(const char *portName, const SerialOptions &options, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : CommConnection(blockingTime, debug, noReads, bufferOptions) {
+	connected = false;
+	// a port that doesn't block can be read until it runs dry, such as by an IoReactor
+	ser = open (portName, O_RDWR | O_NOCTTY | O_CLOEXEC | (options.syncWrites ? O_SYNC : 0) | (blockingTime != -1 ? O_NONBLOCK : 0));
+	if (ser < 0) {
+		fprintf(stderr, "error %d opening %s\n", errno, portName);
+		return;
+	}
+	if(set_interface_attribs (-1, options.parity, options.minBytes, options.interByteTimeout) != 0 || !setBaudRate(options.baudRate)) {
+		fprintf(stderr, "Could not set serial parameters.\n");
+		close(ser);
+		ser = -1;
+		return;
+	}
+	if(options.lowLatency) {
+		setLowLatencyMode(true);
+	}
+	connected = true;
+}
+
 SerialConnection::SerialConnection(const SerialConnection &other) : CommConnection(other) {
     if(this == &other) {
         return;
@@ -121,5 +221,19 @@ SerialConnection &SerialConnection::operator=(const SerialConnection &other) {
 bool SerialConnection::write(const char *buff, const int &buffSize) {
 	if(!connected) 
 		return false;
-	return ::write(ser, buff, buffSize) != -1;
+	int written = 0;
+	while(written < buffSize) {
+		int result = ::write(ser, buff+written, buffSize-written);
+		if(result >= 0) {
+			written += result;
+		} else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+			// a port that doesn't block takes what fits in the driver's buffer, so wait for it to drain
+			if(!waitForWritable(ser, -1)) {
+				return false;
+			}
+		} else if(errno != EINTR) {
+			return false;
+		}
+	}
+	return true;
 }
@@ -0,0 +1,379 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "../SharedMemoryConnection.h"
+#include <climits>
+#include <algorithm>
+
+// copies length bytes starting at the index in a ring of capacity bytes into buff, splitting the copy where it wraps
+static void copyFromRing(const char *ring, const size_t &capacity, const uint64_t &index, char *buff, const size_t &length) {
+	size_t offset = index & (capacity-1);
+	size_t first = std::min(length, capacity-offset);
+	memcpy(buff, ring+offset, first);
+	memcpy(buff+first, ring, length-first);
+}
+
+// copies length bytes of buff into a ring of capacity bytes starting at the index
+static void copyToRing(char *ring, const size_t &capacity, const uint64_t &index, const char *buff, const size_t &length) {
+	size_t offset = index & (capacity-1);
+	size_t first = std::min(length, capacity-offset);
+	memcpy(ring+offset, buff, first);
+	memcpy(ring, buff+first, length-first);
+}
+
+// protected:
+bool SharedMemoryConnection::futexWait(std::atomic<uint32_t> *word, const uint32_t &value, const int &timeout) {
+	struct timespec wait;
+	wait.tv_sec = timeout/1000;
+	wait.tv_nsec = (timeout%1000)*1000000L;
+	// the word is shared with another process, so the futex can't be FUTEX_PRIVATE_FLAG
+	return syscall(SYS_futex, (uint32_t *) word, FUTEX_WAIT, value, timeout >= 0 ? &wait : NULL, NULL, 0) == 0 || errno != ETIMEDOUT;
+}
+
+void SharedMemoryConnection::futexWake(std::atomic<uint32_t> *word) {
+	syscall(SYS_futex, (uint32_t *) word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+bool SharedMemoryConnection::createSegment(const size_t &ringSize) {
+	capacity = 1;
+	while(capacity < ringSize) {
+		capacity <<= 1;
+	}
+	for(int attempt = 0; shmFd < 0; attempt++) {
+		shmFd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+		if(shmFd >= 0) {
+			break;
+		} else if(errno != EEXIST || attempt > 0) {
+			fprintf(stderr, "ERROR making shared memory %s: %d\n", name.c_str(), errno);
+			return false;
+		}
+		// a segment outlives the processes that used it, so one is only in use if the side that made it is still around
+		int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+		struct stat info;
+		if(fd >= 0 && fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(SharedSegment)) {
+			void *mapping = mmap(NULL, sizeof(SharedSegment), PROT_READ, MAP_SHARED, fd, 0);
+			if(mapping != MAP_FAILED) {
+				SharedSegment *old = (SharedSegment *) mapping;
+				int32_t pid = old->pids[0].load();
+				bool live = old->magic.load() == _SHM_MAGIC && old->closed[0].load() == 0 && pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+				munmap(mapping, sizeof(SharedSegment));
+				if(live) {
+					close(fd);
+					fprintf(stderr, "ERROR making shared memory %s. Is it already taken?\n", name.c_str());
+					return false;
+				}
+			}
+		}
+		if(fd >= 0) {
+			close(fd);
+		}
+		if(shm_unlink(name.c_str()) < 0 && debug) {
+			printf("Could not remove the old shared memory %s. errno = %d\n", name.c_str(), errno);
+		}
+	}
+	size_t size = sizeof(SharedSegment)+2*capacity;
+	if(ftruncate(shmFd, size) < 0) {
+		fprintf(stderr, "ERROR sizing shared memory %s: %d\n", name.c_str(), errno);
+		return false;
+	}
+	if(!mapSegment(size)) {
+		return false;
+	}
+	// ftruncate(2) zeroed the segment, so only what isn't 0 has to be set
+	segment->capacity = capacity;
+	segment->pids[0].store(getpid());
+	segment->magic.store(_SHM_MAGIC, std::memory_order_release);
+	return true;
+}
+
+bool SharedMemoryConnection::openSegment() {
+	while(!interruptRead) {
+		shmFd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+		struct stat info;
+		if(shmFd >= 0 && fstat(shmFd, &info) == 0 && (size_t) info.st_size > sizeof(SharedSegment)) {
+			capacity = (info.st_size-sizeof(SharedSegment))/2;
+			if(mapSegment(info.st_size)) {
+				if(segment->magic.load(std::memory_order_acquire) == _SHM_MAGIC && segment->capacity == capacity && !peerGone(true)) {
+					int32_t none = 0;
+					if(segment->pids[1].compare_exchange_strong(none, getpid())) {
+						printf("Connected to shared memory %s.\n", name.c_str());
+						return true;
+					}
+					fprintf(stderr, "ERROR opening shared memory %s. Another process already has it open\n", name.c_str());
+					return false;
+				}
+				munmap(segment, segmentSize);
+				segment = NULL;
+			}
+		}
+		if(shmFd >= 0) {
+			close(shmFd);
+			shmFd = -1;
+		}
+		fprintf(stderr, "Couldn't open shared memory %s. Will retry in %d milliseconds.\n", name.c_str(), _SHM_RETRY_DELAY);
+		// terminate() signals wakeFd, so it doesn't have to wait out the delay
+		waitForReadable(wakeFd, _SHM_RETRY_DELAY);
+	}
+	return false;
+}
+
+bool SharedMemoryConnection::mapSegment(const size_t &size) {
+	void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+	if(mapping == MAP_FAILED) {
+		fprintf(stderr, "ERROR mapping shared memory %s: %d\n", name.c_str(), errno);
+		return false;
+	}
+	segment = (SharedSegment *) mapping;
+	segmentSize = size;
+	char *data = (char *) mapping+sizeof(SharedSegment);
+	outgoing = &segment->rings[side];
+	incoming = &segment->rings[1-side];
+	outgoingData = data+side*capacity;
+	incomingData = data+(1-side)*capacity;
+	return true;
+}
+
+bool SharedMemoryConnection::peerGone(const bool &checkProcess) const {
+	int peer = 1-side;
+	if(segment->closed[peer].load(std::memory_order_acquire) != 0) {
+		return true;
+	}
+	int32_t pid = segment->pids[peer].load(std::memory_order_relaxed);
+	return checkProcess && pid != 0 && kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+uint64_t SharedMemoryConnection::awaitIncoming(const uint64_t &tail) {
+	uint64_t head;
+	if(lowLatency.spinMicros > 0) {
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now()+std::chrono::microseconds(lowLatency.spinMicros);
+		do {
+			if((head = incoming->head.load(std::memory_order_acquire)) != tail) {
+				return head;
+			}
+			cpuRelax();
+		} while(std::chrono::steady_clock::now() < end);
+	}
+	// whether the peer's process is checked on, which is only done after a wait timed out since it costs a syscall
+	bool checkProcess = false;
+	while(!interruptRead && !peerGone(checkProcess)) {
+		incoming->consumerParked.store(1, std::memory_order_relaxed);
+		// pairs with the fence in write(2), so either the producer sees consumerParked or this sees the new head
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		uint32_t seq = incoming->dataSeq.load(std::memory_order_acquire);
+		head = incoming->head.load(std::memory_order_acquire);
+		if(head == tail && !interruptRead) {
+			checkProcess = !futexWait(&incoming->dataSeq, seq, _SHM_PEER_CHECK);
+			head = incoming->head.load(std::memory_order_acquire);
+		}
+		incoming->consumerParked.store(0, std::memory_order_relaxed);
+		if(head != tail) {
+			return head;
+		}
+	}
+	// what the peer wrote before it went away is still read
+	return incoming->head.load(std::memory_order_acquire);
+}
+
+bool SharedMemoryConnection::awaitSpace(const uint64_t &head) {
+	bool checkProcess = false;
+	while(!terminated && !peerGone(checkProcess)) {
+		outgoing->producerParked.store(1, std::memory_order_relaxed);
+		// pairs with the fence in getData(2), so either the consumer sees producerParked or this sees the new tail
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		uint32_t seq = outgoing->spaceSeq.load(std::memory_order_acquire);
+		uint64_t tail = outgoing->tail.load(std::memory_order_acquire);
+		if(head-tail >= capacity && !terminated) {
+			checkProcess = !futexWait(&outgoing->spaceSeq, seq, _SHM_PEER_CHECK);
+			tail = outgoing->tail.load(std::memory_order_acquire);
+		}
+		outgoing->producerParked.store(0, std::memory_order_relaxed);
+		if(head-tail < capacity) {
+			return true;
+		}
+	}
+	errno = terminated ? ECANCELED : EPIPE;
+	return false;
+}
+
+void SharedMemoryConnection::wakeReader() {
+	if(segment != NULL) {
+		// a writer waiting for room is woken too, so it sees that the connection is being terminated
+		incoming->dataSeq.fetch_add(1);
+		futexWake(&incoming->dataSeq);
+		outgoing->spaceSeq.fetch_add(1);
+		futexWake(&outgoing->spaceSeq);
+	}
+}
+
+void SharedMemoryConnection::failedRead() {
+	if(debug) {
+		printf("Failed to read from shared memory. errno = %d\n", errno);
+	}
+	connected = false;
+	// the peer is gone for good, so there is nothing more to read
+	std::lock_guard<std::mutex> lk(dataMutex);
+	interruptRead = true;
+}
+
+int SharedMemoryConnection::getData(char *buff, const int &buffSize) {
+	BufferRegion region;
+	region.data = buff;
+	region.length = buffSize;
+	return getData(&region, 1);
+}
+
+int SharedMemoryConnection::getData(BufferRegion *regions, const int &regionCount) {
+	if(!connected || segment == NULL) {
+		return -1;
+	}
+	uint64_t tail = incoming->tail.load(std::memory_order_relaxed);
+	uint64_t head = incoming->head.load(std::memory_order_acquire);
+	if(head == tail) {
+		head = awaitIncoming(tail);
+		if(head == tail) {
+			if(interruptRead) {
+				return 0;
+			}
+			errno = ENOTCONN;
+			return -1;
+		}
+	}
+	size_t length = head-tail, copied = 0;
+	for(int i = 0; i < regionCount && copied < length; i++) {
+		size_t part = std::min(regions[i].length, length-copied);
+		copyFromRing(incomingData, capacity, tail+copied, regions[i].data, part);
+		copied += part;
+	}
+	incoming->tail.store(tail+copied, std::memory_order_release);
+	// pairs with the fence in awaitSpace(1)
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(incoming->producerParked.load(std::memory_order_relaxed) != 0) {
+		incoming->spaceSeq.fetch_add(1);
+		futexWake(&incoming->spaceSeq);
+	}
+	return copied;
+}
+
+bool SharedMemoryConnection::readsInPlace() const {
+	return false;
+}
+
+void SharedMemoryConnection::exitGracefully() {
+	// a writer may still be copying into the segment, so it has to be done before the segment is unmapped
+	std::lock_guard<std::mutex> lk(writeMutex);
+	connected = false;
+	if(segment != NULL) {
+		segment->closed[side].store(1, std::memory_order_release);
+		// the other side may be parked waiting for this one to write or to make room
+		outgoing->dataSeq.fetch_add(1);
+		futexWake(&outgoing->dataSeq);
+		incoming->spaceSeq.fetch_add(1);
+		futexWake(&incoming->spaceSeq);
+		munmap(segment, segmentSize);
+		segment = NULL;
+		if(creator) {
+			shm_unlink(name.c_str());
+		}
+	}
+	if(shmFd >= 0) {
+		close(shmFd);
+		shmFd = -1;
+	}
+}
+
+bool SharedMemoryConnection::setBlocking(const int &blockingTime) {
+	// the reader always waits on a futex, which terminate() can wake
+	return true;
+}
+
+// public:
+SharedMemoryConnection::SharedMemoryConnection(const char *name, const bool &create, const size_t &ringSize, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : CommConnection(blockingTime, debug, noReads, bufferOptions) {
+	this->name = name[0] == '/' ? std::string(name) : std::string("/")+name;
+	creator = create;
+	side = create ? 0 : 1;
+	shmFd = -1;
+	segment = NULL;
+	segmentSize = 0;
+	capacity = 0;
+	incoming = NULL;
+	outgoing = NULL;
+	incomingData = NULL;
+	outgoingData = NULL;
+	connected = false;
+	if(create ? !createSegment(ringSize) : !openSegment()) {
+		fprintf(stderr, "Could not setup shared memory connection %s\n", this->name.c_str());
+		return;
+	}
+	connected = true;
+}
+
+SharedMemoryConnection::SharedMemoryConnection(const SharedMemoryConnection &other) : CommConnection(other) {
+    if(this == &other) {
+        return;
+    }
+    shmFd = -1;
+    segment = NULL;
+    *this = other;
+}
+
+SharedMemoryConnection &SharedMemoryConnection::operator=(const SharedMemoryConnection &other) {
+    if(this == &other) {
+        return *this;
+    }
+    if(segment != NULL) {
+        munmap(segment, segmentSize);
+        segment = NULL;
+    }
+    if(shmFd >= 0) {
+        close(shmFd);
+    }
+    name = other.name;
+    creator = other.creator;
+    side = other.side;
+    capacity = other.capacity;
+    shmFd = other.shmFd >= 0 ? fcntl(other.shmFd, F_DUPFD_CLOEXEC, 0) : -1;
+    if(shmFd >= 0) {
+        mapSegment(other.segmentSize);
+    }
+    CommConnection::operator=(other);
+    return *this;
+}
+
+bool SharedMemoryConnection::isPeerAttached() const {
+	return segment != NULL && segment->pids[1-side].load() != 0;
+}
+
+bool SharedMemoryConnection::write(const char *buff, const int &buffSize) {
+	std::lock_guard<std::mutex> lk(writeMutex);
+	if(!connected || segment == NULL)
+		return false;
+	if(peerGone(false)) {
+		errno = EPIPE;
+		return false;
+	}
+	uint64_t head = outgoing->head.load(std::memory_order_relaxed);
+	size_t written = 0;
+	while(written < (size_t) buffSize) {
+		size_t space = capacity-(head-outgoing->tail.load(std::memory_order_acquire));
+		if(space == 0) {
+			if(!awaitSpace(head)) {
+				return false;
+			}
+			continue;
+		}
+		size_t length = std::min(space, buffSize-written);
+		copyToRing(outgoingData, capacity, head, buff+written, length);
+		head += length;
+		written += length;
+		outgoing->head.store(head, std::memory_order_release);
+		// pairs with the fence in awaitIncoming(1)
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(outgoing->consumerParked.load(std::memory_order_relaxed) != 0) {
+			outgoing->dataSeq.fetch_add(1);
+			futexWake(&outgoing->dataSeq);
+		}
+	}
+	return true;
+}
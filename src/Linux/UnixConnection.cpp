@@ -0,0 +1,286 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "../UnixConnection.h"
+
+// protected:
+bool UnixConnection::makeAddress(const std::string &path, struct sockaddr_un &addr, socklen_t &length) {
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	// an abstract name starts with a null byte instead of '@', and isn't null terminated
+	bool abstract = !path.empty() && path[0] == '@';
+	if(path.empty() || path.size() > sizeof(addr.sun_path)-(abstract ? 0 : 1)) {
+		return false;
+	}
+	memcpy(addr.sun_path, path.data(), path.size());
+	if(abstract) {
+		addr.sun_path[0] = '\0';
+	}
+	length = offsetof(struct sockaddr_un, sun_path)+path.size()+(abstract ? 0 : 1);
+	return true;
+}
+
+bool UnixConnection::setupServer() {
+	mSocket = socket(AF_UNIX, socketType | SOCK_CLOEXEC, 0);
+	if(mSocket < 0) {
+		fprintf(stderr, "ERROR opening socket: %d\n", errno);
+		return false;
+	}
+	struct stat info;
+	if(path[0] != '@' && stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+		// a socket file outlives the server that made it, so one is only in use if something still answers on it
+		int probe = socket(AF_UNIX, socketType | SOCK_CLOEXEC, 0);
+		bool live = probe >= 0 && connect(probe, (struct sockaddr *) &mAddr, mAddrLength) == 0;
+		if(probe >= 0) {
+			close(probe);
+		}
+		if(!live && unlink(path.c_str()) < 0 && debug) {
+			printf("Could not remove the old socket at %s. errno = %d\n", path.c_str(), errno);
+		}
+	}
+	if(bind(mSocket, (struct sockaddr *) &mAddr, mAddrLength) < 0) {
+		fprintf(stderr, "ERROR on binding to %s. Is it already taken?\n", path.c_str());
+		close(mSocket);
+		mSocket = -1;
+		return false;
+	}
+	if(socketType == SOCK_DGRAM) {
+		connected = true;
+		printf("Successfully setup socket server.\n");
+		return true;
+	}
+	return waitForClientConnection();
+}
+
+bool UnixConnection::waitForClientConnection() {
+	listen(mSocket, 5);
+	printf("Waiting for client connection...\n");
+	while(!interruptRead) {
+		if(!waitForReadable(mSocket, blockingTime > 0 ? blockingTime : -1)) {
+			continue;
+		}
+		clientSocket = accept4(mSocket, NULL, NULL, SOCK_CLOEXEC | (blockingTime >= 0 ? SOCK_NONBLOCK : 0));
+		if(clientSocket >= 0) {
+			printf("Client connected!\n");
+			connected = true;
+			return true;
+		} else if(errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+			fprintf(stderr, "Accepting a connection failed with errno %d\n", errno);
+			return false;
+		}
+	}
+	return false;
+}
+
+bool UnixConnection::connectToServer() {
+	while(!interruptRead) {
+		int fd = socket(AF_UNIX, socketType | SOCK_CLOEXEC, 0);
+		if(fd < 0) {
+			fprintf(stderr, "ERROR opening socket: %d\n", errno);
+			return false;
+		}
+		// a datagram client needs an address of its own to be answered at, so the kernel is asked to pick an abstract one
+		sa_family_t family = AF_UNIX;
+		if(socketType == SOCK_DGRAM && bind(fd, (struct sockaddr *) &family, sizeof(family)) < 0 && debug) {
+			printf("Could not bind the client to an address. errno = %d\n", errno);
+		}
+		if(connect(fd, (struct sockaddr *) &mAddr, mAddrLength) == 0) {
+			if(blockingTime != -1) {
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+			}
+			// the new socket takes over the old one's number, so a writer that is still holding it sends on the new connection
+			if(mSocket < 0) {
+				mSocket = fd;
+			} else if(dup2(fd, mSocket) < 0) {
+				fprintf(stderr, "Could not replace the socket. errno = %d\n", errno);
+				close(fd);
+				return false;
+			} else {
+				close(fd);
+			}
+			printf("Connected to server.\n");
+			connected = true;
+			return true;
+		}
+		close(fd);
+		fprintf(stderr, "Couldn't connect to server. Will retry in %d milliseconds.\n", _UNIX_RETRY_DELAY);
+		// terminate() signals wakeFd, so it doesn't have to wait out the delay
+		waitForReadable(wakeFd, _UNIX_RETRY_DELAY);
+	}
+	return false;
+}
+
+void UnixConnection::failedRead() {
+	int error = errno;
+	if(debug) {
+		printf("Failed to read from socket. errno = %d\n", error);
+	}
+	connected = false;
+	if(socketType == SOCK_DGRAM) {
+		// there is no one to reconnect to, and reading again would only fail again
+		std::lock_guard<std::mutex> lk(dataMutex);
+		interruptRead = true;
+	} else if(server) {
+		if(clientSocket >= 0) {
+			close(clientSocket);
+			clientSocket = -1;
+		}
+		waitForClientConnection();
+	} else if(!connectToServer()) {
+		// the unread data in buffer is kept, so the user picks up where the old connection left off
+		std::lock_guard<std::mutex> lk(dataMutex);
+		interruptRead = true;
+	}
+}
+
+int UnixConnection::getData(char *buff, const int &buffSize) {
+	BufferRegion region;
+	region.data = buff;
+	region.length = buffSize;
+	return getData(&region, 1);
+}
+
+int UnixConnection::getData(BufferRegion *regions, const int &regionCount) {
+	if(!connected || interruptRead) {
+		return -1;
+	}
+	struct iovec iov[2];
+	for(int i = 0; i < regionCount; i++) {
+		iov[i].iov_base = regions[i].data;
+		iov[i].iov_len = regions[i].length;
+	}
+	if(socketType == SOCK_DGRAM) {
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = regionCount;
+		if(server) {
+			msg.msg_name = &rAddr;
+			msg.msg_namelen = sizeof(rAddr);
+		}
+		int bytesRead = recvmsg(mSocket, &msg, 0);
+		if(bytesRead >= 0 && server) {
+			rAddrLength = msg.msg_namelen;
+		}
+		return bytesRead;
+	}
+	int bytesRead = readv(getFileDescriptor(), iov, regionCount);
+	if(bytesRead == 0 && regions[0].length > 0) {
+		// the peer has closed its end, so let failedRead() wait for the next client or reconnect
+		errno = ENOTCONN;
+		return -1;
+	}
+	return bytesRead;
+}
+
+int UnixConnection::getFileDescriptor() const {
+	if(server && socketType != SOCK_DGRAM) {
+		return clientSocket;
+	}
+	return mSocket;
+}
+
+bool UnixConnection::readsInPlace() const {
+	return !server || socketType != SOCK_DGRAM;
+}
+
+void UnixConnection::exitGracefully() {
+	connected = false;
+	if(clientSocket >= 0) {
+		close(clientSocket);
+		clientSocket = -1;
+	}
+	if(mSocket >= 0) {
+		close(mSocket);
+		mSocket = -1;
+		if(server && path[0] != '@') {
+			unlink(path.c_str());
+		}
+	}
+}
+
+bool UnixConnection::setBlocking(const int &blockingTime) {
+	if(blockingTime != -1 && mSocket >= 0) {
+		if(fcntl(mSocket, F_SETFL, fcntl(mSocket, F_GETFL) | O_NONBLOCK) < 0) {
+			fprintf(stderr, "Could not set socket to nonblocking with error %d", errno);
+			return false;
+		}
+	}
+	return true;
+}
+
+// public:
+UnixConnection::UnixConnection(const char *path, const int &socketType, const bool &server, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : CommConnection(blockingTime, debug, noReads, bufferOptions) {
+	this->path = path;
+	this->socketType = socketType;
+	this->server = server;
+	mSocket = -1;
+	clientSocket = -1;
+	memset(&rAddr, 0, sizeof(rAddr));
+	rAddrLength = 0;
+	connected = false;
+	if(!makeAddress(this->path, mAddr, mAddrLength)) {
+		fprintf(stderr, "%s can't be used as the address of a Unix domain socket\n", path);
+		return;
+	}
+	if(server ? !setupServer() : !connectToServer()) {
+		fprintf(stderr, "Could not setup Unix domain socket %s at %s\n", server ? "server" : "client", path);
+	}
+	setBlocking(blockingTime);
+}
+
+UnixConnection::UnixConnection(const UnixConnection &other) : CommConnection(other) {
+    if(this == &other) {
+        return;
+    }
+    *this = other;
+}
+
+UnixConnection &UnixConnection::operator=(const UnixConnection &other) {
+    if(this == &other) {
+        return *this;
+    }
+    mSocket = other.mSocket;
+    clientSocket = other.clientSocket;
+    socketType = other.socketType;
+    server = other.server;
+    path = other.path;
+    mAddr = other.mAddr;
+    mAddrLength = other.mAddrLength;
+    rAddr = other.rAddr;
+    rAddrLength = other.rAddrLength;
+    CommConnection::operator=(other);
+    return *this;
+}
+
+bool UnixConnection::write(const char *buff, const int &buffSize) {
+	if(!connected)
+		return false;
+	if(socketType == SOCK_DGRAM && server) {
+		// a datagram server answers whoever it last heard from
+		if(rAddrLength <= sizeof(sa_family_t)) {
+			errno = EDESTADDRREQ;
+			return false;
+		}
+		return sendto(mSocket, buff, buffSize, MSG_NOSIGNAL, (struct sockaddr *) &rAddr, rAddrLength) >= 0;
+	}
+	std::lock_guard<std::mutex> lk(writeMutex);
+	int fd = getFileDescriptor();
+	int sent = 0;
+	while(sent < buffSize) {
+		ssize_t result = send(fd, buff+sent, buffSize-sent, MSG_NOSIGNAL);
+		if(result >= 0) {
+			sent += result;
+		} else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+			// a socket that doesn't block is full, so wait for the peer to read some of it
+			if(!waitForWritable(fd, -1)) {
+				return false;
+			}
+		} else if(errno != EINTR) {
+			return false;
+		}
+	}
+	return true;
+}
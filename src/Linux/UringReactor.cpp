@@ -0,0 +1,694 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "../UringReactor.h"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+// protected:
+bool UringReactor::setupRing(const unsigned int &sqPollMillis) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	if(sqPollMillis > 0) {
+		params.flags |= IORING_SETUP_SQPOLL;
+		params.sq_thread_idle = sqPollMillis;
+	}
+	ringFd = syscall(__NR_io_uring_setup, _URING_ENTRIES, &params);
+	if(ringFd < 0) {
+		if(debug) {
+			printf("io_uring isn't available, so UringReactor is using epoll. errno = %d\n", errno);
+		}
+		return false;
+	}
+	sqPoll = sqPollMillis > 0;
+	sqRingSize = params.sq_off.array+params.sq_entries*sizeof(unsigned int);
+	cqRingSize = params.cq_off.cqes+params.cq_entries*sizeof(struct io_uring_cqe);
+	bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if(singleMapping) {
+		// both rings are in one mapping, which has to be big enough for either
+		sqRingSize = cqRingSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+	}
+	sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	sqRing = sqRing == MAP_FAILED ? NULL : sqRing;
+	if(singleMapping) {
+		cqRing = sqRing;
+	} else {
+		cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		cqRing = cqRing == MAP_FAILED ? NULL : cqRing;
+	}
+	sqesSize = params.sq_entries*sizeof(struct io_uring_sqe);
+	void *entries = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	sqes = entries == MAP_FAILED ? NULL : (struct io_uring_sqe *) entries;
+	if(sqRing == NULL || cqRing == NULL || sqes == NULL) {
+		fprintf(stderr, "UringReactor could not map its rings with errno %d\n", errno);
+		teardownRing();
+		return false;
+	}
+	char *sq = (char *) sqRing;
+	char *cq = (char *) cqRing;
+	sqHead = (unsigned int *) (sq+params.sq_off.head);
+	sqTail = (unsigned int *) (sq+params.sq_off.tail);
+	sqMask = (unsigned int *) (sq+params.sq_off.ring_mask);
+	sqArray = (unsigned int *) (sq+params.sq_off.array);
+	sqFlags = (unsigned int *) (sq+params.sq_off.flags);
+	cqHead = (unsigned int *) (cq+params.cq_off.head);
+	cqTail = (unsigned int *) (cq+params.cq_off.tail);
+	cqMask = (unsigned int *) (cq+params.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe *) (cq+params.cq_off.cqes);
+	sqEntries = params.sq_entries;
+	// left blocking, since the ring would only be told EAGAIN for a read on a non blocking file that has nothing yet
+	ringWakeFd = eventfd(0, EFD_CLOEXEC);
+	if(ringWakeFd < 0) {
+		fprintf(stderr, "UringReactor could not make its eventfd with errno %d\n", errno);
+		teardownRing();
+		return false;
+	}
+	// the tables start out empty so connections can be registered one at a time as they are added
+	struct io_uring_rsrc_register tables;
+	memset(&tables, 0, sizeof(tables));
+	tables.nr = _URING_SLOTS;
+	tables.flags = IORING_RSRC_REGISTER_SPARSE;
+	if(syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_FILES2, &tables, sizeof(tables)) < 0 ||
+			syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS2, &tables, sizeof(tables)) < 0) {
+		if(debug) {
+			printf("UringReactor can't register files and buffers, so connections will be read without. errno = %d\n", errno);
+		}
+	} else {
+		for(int slot = _URING_SLOTS-1; slot >= 0; slot--) {
+			freeSlots.push_back(slot);
+		}
+	}
+	return true;
+}
+
+void UringReactor::teardownRing() {
+	if(sqes != NULL) {
+		munmap(sqes, sqesSize);
+		sqes = NULL;
+	}
+	if(cqRing != NULL && cqRing != sqRing) {
+		munmap(cqRing, cqRingSize);
+	}
+	cqRing = NULL;
+	if(sqRing != NULL) {
+		munmap(sqRing, sqRingSize);
+		sqRing = NULL;
+	}
+	if(ringFd >= 0) {
+		close(ringFd);
+		ringFd = -1;
+	}
+	if(ringWakeFd >= 0) {
+		close(ringWakeFd);
+		ringWakeFd = -1;
+	}
+	usingRing = false;
+}
+
+int UringReactor::enter(const unsigned int &waitFor) {
+	unsigned int flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+	unsigned int toSubmit = sqEntries;
+	if(sqPoll) {
+		// the kernel thread takes submissions by itself and only has to be woken if it went to sleep
+		toSubmit = 0;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(__atomic_load_n(sqFlags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+			flags |= IORING_ENTER_SQ_WAKEUP;
+		}
+		if(flags == 0) {
+			return 0;
+		}
+	}
+	return syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, flags, NULL, 0);
+}
+
+struct io_uring_sqe *UringReactor::getSqe() {
+	for(int attempt = 0; attempt < 2; attempt++) {
+		unsigned int head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+		if(*sqTail-head < sqEntries) {
+			struct io_uring_sqe *sqe = &sqes[*sqTail & *sqMask];
+			memset(sqe, 0, sizeof(*sqe));
+			return sqe;
+		}
+		// the kernel hasn't taken what is queued yet, so have it handed over to make room
+		if(sqPoll || onRingThread()) {
+			enter(0);
+		} else if(ringThread != NULL) {
+			wakeRing();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	return NULL;
+}
+
+void UringReactor::publish() {
+	unsigned int tail = *sqTail;
+	sqArray[tail & *sqMask] = tail & *sqMask;
+	__atomic_store_n(sqTail, tail+1, __ATOMIC_RELEASE);
+	inFlight++;
+}
+
+void UringReactor::cancel(const unsigned long long &userData) {
+	struct io_uring_sqe *sqe = getSqe();
+	if(sqe == NULL) {
+		fprintf(stderr, "UringReactor could not cancel a submission\n");
+		return;
+	}
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = userData;
+	publish();
+}
+
+bool UringReactor::onRingThread() const {
+	return ringThread != NULL && ringThread->get_id() == std::this_thread::get_id();
+}
+
+void UringReactor::wakeRing() {
+	if(sqPoll) {
+		// the kernel's thread submits, so it only has to be woken. The ring thread is only needed to see terminate()
+		enter(0);
+		if(!interrupt) {
+			return;
+		}
+	} else if(onRingThread()) {
+		// it submits the next time it waits
+		return;
+	}
+	unsigned long long one = 1;
+	if(::write(ringWakeFd, &one, sizeof(one)) < 0 && debug) {
+		printf("UringReactor could not wake its thread. errno = %d\n", errno);
+	}
+}
+
+void UringReactor::submitWakeRead() {
+	struct io_uring_sqe *sqe = getSqe();
+	if(sqe == NULL) {
+		fprintf(stderr, "UringReactor could not wait to be woken\n");
+		return;
+	}
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = ringWakeFd;
+	sqe->addr = (unsigned long long) &ringWakeValue;
+	sqe->len = sizeof(ringWakeValue);
+	sqe->off = (unsigned long long) -1;
+	sqe->user_data = (unsigned long long) &ringWakeValue | OP_READ;
+	publish();
+}
+
+bool UringReactor::registerFile(const int &slot, const int &fd) {
+	struct io_uring_rsrc_update2 update;
+	memset(&update, 0, sizeof(update));
+	update.offset = slot;
+	update.data = (unsigned long long) &fd;
+	update.nr = 1;
+	return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_FILES_UPDATE2, &update, sizeof(update)) >= 0;
+}
+
+bool UringReactor::registerBuffer(const int &slot, const BufferRegion &storage) {
+	struct iovec iov;
+	iov.iov_base = storage.data;
+	iov.iov_len = storage.length;
+	struct io_uring_rsrc_update2 update;
+	memset(&update, 0, sizeof(update));
+	update.offset = slot;
+	update.data = (unsigned long long) &iov;
+	update.nr = 1;
+	if(syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof(update)) < 0) {
+		if(debug && storage.data != NULL) {
+			printf("UringReactor could not register a buffer, so it will be read into without. errno = %d\n", errno);
+		}
+		return false;
+	}
+	return true;
+}
+
+void UringReactor::submitRead(CommConnection *conn, RingRegistration &registration) {
+	char *discard = registration.discard.empty() ? NULL : &registration.discard[0];
+	while(conn->prepareRead(registration.regions, registration.regionCount, discard) == CommConnection::READ_FULL) {
+		// like IoReactor::handle(2), the user submits the read from notifyConsumed() once it is drained, unless it already was
+		conn->readerWaiting.store(true);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(conn->buffer.available() > conn->drainedLevel() || !conn->readerWaiting.exchange(false)) {
+			registration.waitingForSpace = true;
+			return;
+		}
+	}
+	registration.waitingForSpace = false;
+	bool fixed = false;
+	if(registration.slot >= 0 && registration.regions[0].data != discard) {
+		BufferRegion storage = conn->buffer.storageRegion();
+		if(storage.data != registration.registered.data || storage.length != registration.registered.length) {
+			// the buffer was resized, so its new storage takes the place of the old one
+			if(!registerBuffer(registration.slot, storage)) {
+				storage.data = NULL;
+				storage.length = 0;
+			}
+			registration.registered = storage;
+		}
+		// a registered buffer can only be read into in one piece
+		fixed = registration.registered.data != NULL && registration.regionCount == 1;
+	}
+	struct io_uring_sqe *sqe = getSqe();
+	if(sqe == NULL) {
+		fprintf(stderr, "UringReactor could not submit a read\n");
+		return;
+	}
+	if(fixed) {
+		sqe->opcode = IORING_OP_READ_FIXED;
+		sqe->addr = (unsigned long long) registration.regions[0].data;
+		sqe->len = registration.regions[0].length;
+		sqe->buf_index = registration.slot;
+	} else {
+		for(int i = 0; i < registration.regionCount; i++) {
+			registration.iov[i].iov_base = registration.regions[i].data;
+			registration.iov[i].iov_len = registration.regions[i].length;
+		}
+		sqe->opcode = IORING_OP_READV;
+		sqe->addr = (unsigned long long) registration.iov;
+		sqe->len = registration.regionCount;
+	}
+	if(registration.slot >= 0) {
+		sqe->fd = registration.slot;
+		sqe->flags |= IOSQE_FIXED_FILE;
+	} else {
+		sqe->fd = registration.fd;
+	}
+	// the file's own position, which streams don't have
+	sqe->off = (unsigned long long) -1;
+	sqe->user_data = (unsigned long long) conn | OP_READ;
+	publish();
+	registration.reading = true;
+	registration.readOperation = OP_READ;
+}
+
+bool UringReactor::submitPoll(const unsigned long long &userData, RingRegistration &registration, const short &events) {
+	struct io_uring_sqe *sqe = getSqe();
+	if(sqe == NULL) {
+		fprintf(stderr, "UringReactor could not submit a poll\n");
+		return false;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	if(registration.slot >= 0) {
+		sqe->fd = registration.slot;
+		sqe->flags |= IOSQE_FIXED_FILE;
+	} else {
+		sqe->fd = registration.fd;
+	}
+	sqe->poll32_events = events;
+	sqe->user_data = userData;
+	publish();
+	return true;
+}
+
+bool UringReactor::submitWrite(RingRegistration &registration) {
+	RingWrite *write = registration.writes.front();
+	struct io_uring_sqe *sqe = getSqe();
+	if(sqe == NULL) {
+		fprintf(stderr, "UringReactor could not submit a write\n");
+		return false;
+	}
+	if(registration.isSocket) {
+		sqe->opcode = IORING_OP_SEND;
+		sqe->msg_flags = MSG_NOSIGNAL;
+	} else {
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->off = (unsigned long long) -1;
+	}
+	if(registration.slot >= 0) {
+		sqe->fd = registration.slot;
+		sqe->flags |= IOSQE_FIXED_FILE;
+	} else {
+		sqe->fd = registration.fd;
+	}
+	sqe->addr = (unsigned long long) (write->data+write->written);
+	sqe->len = write->length-write->written;
+	sqe->user_data = (unsigned long long) write | OP_WRITE;
+	publish();
+	registration.writing = true;
+	registration.writeOperation = OP_WRITE;
+	return true;
+}
+
+int UringReactor::writeNow(CommConnection *conn, const char *buff, const size_t &length) {
+	int fd = conn->getFileDescriptor();
+	struct stat status;
+	bool isSocket = fstat(fd, &status) == 0 && S_ISSOCK(status.st_mode);
+	size_t written = 0;
+	while(written < length) {
+		ssize_t result = isSocket ? send(fd, &buff[written], length-written, MSG_NOSIGNAL) : ::write(fd, &buff[written], length-written);
+		if(result >= 0) {
+			written += result;
+		} else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			poll(&pfd, 1, -1);
+		} else if(errno != EINTR) {
+			return -errno;
+		}
+	}
+	return written;
+}
+
+void UringReactor::runRing() {
+	{
+		// the reads are submitted from here, like every other submission, so they belong to this thread
+		std::lock_guard<std::mutex> lk(ringMutex);
+		submitWakeRead();
+		for(std::map<CommConnection *, RingRegistration>::iterator it = ringConnections.begin(); it != ringConnections.end(); it++) {
+			if(!it->second.reading && !it->second.removing) {
+				submitRead(it->first, it->second);
+			}
+		}
+	}
+	while(true) {
+		{
+			std::lock_guard<std::mutex> lk(ringMutex);
+			if(interrupt && inFlight == 0) {
+				break;
+			}
+		}
+		if(enter(1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			fprintf(stderr, "UringReactor failed to wait for completions with errno %d\n", errno);
+			return;
+		}
+		unsigned int head = *cqHead;
+		while(head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe cqe = cqes[head & *cqMask];
+			// the entry is copied out, so the kernel can have it back straight away
+			__atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+			{
+				std::lock_guard<std::mutex> lk(ringMutex);
+				inFlight--;
+			}
+			Operation operation = (Operation) (cqe.user_data & 3);
+			void *target = (void *) (uintptr_t) (cqe.user_data & ~3ULL);
+			if(target == &ringWakeValue) {
+				// another thread published something, which the next wait submits
+				std::lock_guard<std::mutex> lk(ringMutex);
+				if(!interrupt) {
+					submitWakeRead();
+				}
+				continue;
+			} else if(target == NULL) {
+				// a cancel
+				continue;
+			} else if(operation == OP_READ || operation == OP_POLL) {
+				finishRead((CommConnection *) target, operation, cqe.res);
+			} else {
+				finishWrite((RingWrite *) target, operation, cqe.res);
+			}
+		}
+	}
+}
+
+void UringReactor::finishRead(CommConnection *conn, const Operation &operation, const int &result) {
+	std::unique_lock<std::mutex> lk(ringMutex);
+	// remove(1) waits for reading to be cleared, so the registration stays put while the lock is let go
+	RingRegistration &registration = ringConnections[conn];
+	bool lost = false;
+	if(operation == OP_READ && result != -EAGAIN && result != -EINTR && result != -ECANCELED) {
+		lk.unlock();
+		errno = result < 0 ? -result : 0;
+		lost = conn->completeRead(registration.regions, result, registration.discard.empty() ? NULL : &registration.discard[0]) != CommConnection::READ_DATA;
+		if(lost) {
+			// the watch callback may call back into the reactor, so this is done before the lock is taken again
+			lose(conn, result < 0 ? -result : 0);
+		}
+		lk.lock();
+	}
+	registration.reading = false;
+	if(!lost && !registration.removing && !interrupt && result != -ECANCELED) {
+		if(operation == OP_READ && result == -EAGAIN) {
+			// the connection doesn't block, so the kernel has to be asked to wait for data before reading again
+			registration.reading = submitPoll((unsigned long long) conn | OP_POLL, registration, POLLIN | POLLRDHUP);
+			registration.readOperation = OP_POLL;
+		} else {
+			// whatever a poll said, the read after it finds out for itself
+			submitRead(conn, registration);
+		}
+	}
+	ringIdleCv.notify_all();
+}
+
+void UringReactor::finishWrite(RingWrite *write, const Operation &operation, const int &result) {
+	std::unique_lock<std::mutex> lk(ringMutex);
+	RingRegistration &registration = ringConnections[write->conn];
+	registration.writing = false;
+	if(operation == OP_WRITE && result > 0) {
+		write->written += result;
+	}
+	if(!registration.removing && !interrupt && result != -ECANCELED) {
+		if(operation == OP_WRITE && result == -EAGAIN) {
+			registration.writing = submitPoll((unsigned long long) write | OP_WRITE_POLL, registration, POLLOUT);
+			registration.writeOperation = OP_WRITE_POLL;
+		} else if(operation == OP_WRITE_POLL || result == -EINTR || (result > 0 && write->written < write->length)) {
+			// the rest of a partial write goes out before anything queued after it
+			submitWrite(registration);
+		}
+		if(registration.writing) {
+			return;
+		}
+	}
+	registration.writes.pop_front();
+	if(!registration.removing && !interrupt && !registration.writes.empty()) {
+		submitWrite(registration);
+	}
+	ringIdleCv.notify_all();
+	lk.unlock();
+	int outcome = write->written == write->length ? (int) write->written : result < 0 ? result : -EBUSY;
+	if(write->callback) {
+		write->callback(write->conn, write->data, outcome);
+	}
+	delete write;
+}
+
+void UringReactor::lose(CommConnection *conn, const int &error) {
+	if(debug) {
+		printf("UringReactor lost a connection. errno = %d\n", error);
+	}
+	if(conn->startReconnect(error)) {
+		return;
+	}
+	conn->connected = false;
+	{
+		std::lock_guard<std::mutex> lk(conn->dataMutex);
+		conn->interruptRead = true;
+	}
+	conn->cv.notify_all();
+	conn->fireWatch();
+}
+
+// public:
+UringReactor::UringReactor(const int &threadCount, const bool &debug, const unsigned int &sqPollMillis) : IoReactor(threadCount, debug) {
+	ringFd = -1;
+	sqPoll = false;
+	sqRing = NULL;
+	cqRing = NULL;
+	sqes = NULL;
+	sqEntries = 0;
+	inFlight = 0;
+	ringRunning = false;
+	ringThread = NULL;
+	ringWakeFd = -1;
+	ringWakeValue = 0;
+	usingRing = setupRing(sqPollMillis);
+}
+
+UringReactor::~UringReactor() {
+	terminate();
+	teardownRing();
+}
+
+bool UringReactor::isUsingUring() const {
+	return usingRing;
+}
+
+bool UringReactor::begin() {
+	// the epoll(7) threads are still needed for connections that can't be read through the ring
+	bool polling = IoReactor::begin();
+	if(!usingRing) {
+		return polling;
+	}
+	std::lock_guard<std::mutex> lk(ringMutex);
+	if(ringThread != NULL || interrupt) {
+		return false;
+	}
+	ringRunning = true;
+	// the thread submits the reads for the connections added so far once it starts
+	ringThread = new std::thread(&UringReactor::runRing, this);
+	return true;
+}
+
+void UringReactor::terminate() {
+	std::thread *thread = NULL;
+	{
+		std::lock_guard<std::mutex> lk(ringMutex);
+		if(ringThread != NULL) {
+			interrupt = true;
+			for(std::map<CommConnection *, RingRegistration>::iterator it = ringConnections.begin(); it != ringConnections.end(); it++) {
+				if(it->second.reading) {
+					cancel((unsigned long long) it->first | it->second.readOperation);
+				}
+				if(it->second.writing) {
+					cancel((unsigned long long) it->second.writes.front() | it->second.writeOperation);
+				}
+			}
+			// wakes the thread to submit the cancels, and to stop once the read on ringWakeFd finishes
+			wakeRing();
+			thread = ringThread;
+		}
+	}
+	if(thread != NULL) {
+		if(thread->joinable()) {
+			thread->join();
+		}
+		delete thread;
+		std::lock_guard<std::mutex> lk(ringMutex);
+		ringThread = NULL;
+		ringRunning = false;
+	}
+	IoReactor::terminate();
+}
+
+bool UringReactor::add(CommConnection *conn) {
+	int fd = conn->getFileDescriptor();
+	if(!usingRing || fd < 0 || !conn->readsInPlace()) {
+		return IoReactor::add(conn);
+	}
+	std::lock_guard<std::mutex> lk(ringMutex);
+	RingRegistration &registration = ringConnections[conn];
+	registration.fd = fd;
+	registration.slot = -1;
+	registration.registered.data = NULL;
+	registration.registered.length = 0;
+	struct stat status;
+	registration.isSocket = fstat(fd, &status) == 0 && S_ISSOCK(status.st_mode);
+	registration.reading = false;
+	registration.waitingForSpace = false;
+	registration.removing = false;
+	registration.regionCount = 0;
+	registration.writing = false;
+	if(conn->overflowPolicy == OVERFLOW_DROP_NEWEST) {
+		registration.discard.resize(_DISCARD_SIZE);
+	}
+	if(!freeSlots.empty() && registerFile(freeSlots.back(), fd)) {
+		registration.slot = freeSlots.back();
+		freeSlots.pop_back();
+		BufferRegion storage = conn->buffer.storageRegion();
+		if(registerBuffer(registration.slot, storage)) {
+			registration.registered = storage;
+		}
+	}
+	if(ringRunning && !interrupt) {
+		submitRead(conn, registration);
+		wakeRing();
+	}
+	return true;
+}
+
+void UringReactor::remove(CommConnection *conn) {
+	std::unique_lock<std::mutex> lk(ringMutex);
+	std::map<CommConnection *, RingRegistration>::iterator it = ringConnections.find(conn);
+	if(it == ringConnections.end()) {
+		lk.unlock();
+		IoReactor::remove(conn);
+		return;
+	}
+	RingRegistration &registration = it->second;
+	registration.removing = true;
+	if(ringRunning) {
+		if(registration.reading) {
+			cancel((unsigned long long) conn | registration.readOperation);
+		}
+		if(registration.writing) {
+			cancel((unsigned long long) registration.writes.front() | registration.writeOperation);
+		}
+		wakeRing();
+		ringIdleCv.wait(lk, [&registration]() { return !registration.reading && !registration.writing; });
+	}
+	std::deque<RingWrite *> unsent;
+	unsent.swap(registration.writes);
+	if(registration.slot >= 0) {
+		BufferRegion empty;
+		empty.data = NULL;
+		empty.length = 0;
+		registerFile(registration.slot, -1);
+		registerBuffer(registration.slot, empty);
+		freeSlots.push_back(registration.slot);
+	}
+	ringConnections.erase(it);
+	lk.unlock();
+	for(size_t i = 0; i < unsent.size(); i++) {
+		if(unsent[i]->callback) {
+			unsent[i]->callback(conn, unsent[i]->data, -ECANCELED);
+		}
+		delete unsent[i];
+	}
+}
+
+void UringReactor::resume(CommConnection *conn) {
+	std::unique_lock<std::mutex> lk(ringMutex);
+	std::map<CommConnection *, RingRegistration>::iterator it = ringConnections.find(conn);
+	if(it == ringConnections.end()) {
+		lk.unlock();
+		IoReactor::resume(conn);
+		return;
+	}
+	if(ringRunning && !interrupt && !it->second.removing && it->second.waitingForSpace) {
+		submitRead(conn, it->second);
+		wakeRing();
+	}
+}
+
+size_t UringReactor::size() {
+	std::lock_guard<std::mutex> lk(ringMutex);
+	return IoReactor::size()+ringConnections.size();
+}
+
+bool UringReactor::write(CommConnection *conn, const char *buff, const size_t &length, const UringWriteCallback &callback, const bool &submit) {
+	std::unique_lock<std::mutex> lk(ringMutex);
+	std::map<CommConnection *, RingRegistration>::iterator it = ringConnections.find(conn);
+	if(!ringRunning || interrupt || it == ringConnections.end() || it->second.removing) {
+		lk.unlock();
+		int outcome = writeNow(conn, buff, length);
+		if(callback) {
+			callback(conn, buff, outcome);
+		}
+		return outcome >= 0;
+	}
+	RingWrite *write = new RingWrite;
+	write->conn = conn;
+	write->data = buff;
+	write->length = length;
+	write->written = 0;
+	write->callback = callback;
+	it->second.writes.push_back(write);
+	// anything queued ahead of it is submitted when that finishes
+	if(it->second.writes.size() == 1 && !submitWrite(it->second)) {
+		it->second.writes.pop_back();
+		delete write;
+		return false;
+	}
+	if(submit) {
+		wakeRing();
+	}
+	return true;
+}
+
+void UringReactor::submit() {
+	std::lock_guard<std::mutex> lk(ringMutex);
+	if(usingRing) {
+		wakeRing();
+	}
+}
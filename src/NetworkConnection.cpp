@@ -12,11 +12,34 @@
     #error Unsupported os
 #endif
 
-NetworkConnection::NetworkConnection(const int &port, const int &connectionType, const char *ipaddr, const int &blockingTime, const bool &debug, const bool &noReads) : CommConnection(blockingTime, debug, noReads) {
+NetworkConnection::NetworkConnection(const int &port, const int &connectionType, const char *ipaddr, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions, const char *bindAddress) : CommConnection(blockingTime, debug, noReads, bufferOptions) {
 	this->connectionType = connectionType;
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	datagrams = false;
+	batchSize = _DATAGRAM_BATCH;
+	datagramSize = _DATAGRAM_SIZE;
+	gsoUnsupported = false;
+	mtuLimit = 0;
+	mtuKnown = false;
+	writeMode = WRITE_DIRECT;
+	writeThread = NULL;
+	stopWriting = false;
+	writing = false;
+	discardedTo = 0;
+	flushedTo = 0;
+	zeroCopy = false;
+	zeroCopySends = 0;
+	zeroCopyDone = 0;
+	zeroCopyBuffers = 0;
+	zeroCopyRetired = 0;
+	noDelay = false;
+	corked = false;
+	jitterSeed = time(NULL) ^ (uintptr_t) this;
+	hostPort = 0;
+#endif
 	if(strcmp(ipaddr, "") == 0) {
         server = true;
-		if(!setupServer(port)) {
+		if(!setupServer(port, bindAddress)) {
 			fprintf(stderr, "Could not setup socket server on port %d.\n", port);
 		}
 	} else {
@@ -13,7 +13,11 @@
     #include <fcntl.h>
     #include <sys/types.h> 
     #include <sys/socket.h>
+    #include <sys/uio.h>
     #include <netinet/in.h>
+    #include <netinet/udp.h>
+    #include <netinet/tcp.h>
+    #include <linux/errqueue.h>
     #include <netdb.h> 
     #include <errno.h>
 #elif defined(_WIN32)
@@ -31,13 +35,107 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <string>
 #include "CommConnection.h"
+#include "Resolver.h"
+
+// how many datagrams one recvmmsg(2) asks for in datagram mode
+#define _DATAGRAM_BATCH 64
+// the largest datagram that is kept whole in datagram mode by default. Longer ones are truncated
+#define _DATAGRAM_SIZE 2048
+// the largest payload a UDP datagram over IPv4 can have
+#define _MAX_DATAGRAM_SIZE 65507
+// the most datagrams sendmmsg(2) is given at once
+#define _SEND_BATCH 256
+// the most segments the kernel will split one UDP_SEGMENT send into
+#define _GSO_MAX_SEGMENTS 64
+// the largest segment UDP_SEGMENT is asked for when the path MTU can't be found, which fits in a 1500 byte Ethernet frame
+#define _GSO_DEFAULT_SEGMENT 1452
+// default size of the queue that TCP writes wait in when they aren't sent directly
+// 1048576 = 2^20 = 1MB
+#define _WRITE_QUEUE_SIZE 1048576
+
+#if defined(__linux__) || defined(__linux) || defined(linux) 
+// one datagram read by NetworkConnection::readDatagrams(2)
+struct Datagram {
+	// where the payload is copied to, which the caller allocates with capacity bytes
+	char *data;
+	size_t capacity;
+	// how many bytes of the payload were copied, which is less than was sent if it didn't fit in capacity
+	size_t length;
+	// who sent the datagram
+	SocketAddress source;
+};
+
+// one datagram for NetworkConnection::writeDatagrams(1)
+struct OutgoingDatagram {
+	const char *data;
+	size_t length;
+	// where to send it, or NULL to send it where write(2) would
+	const SocketAddress *destination;
+};
+
+// how NetworkConnection::write(2) sends data over TCP
+enum WriteMode {
+	// send on the caller's thread, waiting for room in the socket until all of it is sent
+	WRITE_DIRECT,
+	// copy into the outbound queue and return straight away. writeThread sends it later, along with anything queued after it
+	WRITE_QUEUED,
+	// copy into the outbound queue and wait until writeThread has sent it
+	WRITE_FLUSHED
+};
+
+// is told the id writeZeroCopy(2) gave a buffer once the buffer may be reused, and whether the kernel copied it anyway
+typedef std::function<void(const unsigned long long &, const bool &)> ZeroCopyCallback;
+
+// what a TCP client's connection to its server is doing, as told to its ConnectionStateCallback
+enum ConnectionState {
+	// a connect(2) to the server has been started
+	STATE_CONNECTING,
+	STATE_CONNECTED,
+	// the connection was lost, or an attempt to make it failed, and the next attempt is waiting out its backoff
+	STATE_DISCONNECTED,
+	// maxAttempts attempts in a row failed, so the connection has stopped reading
+	STATE_GAVE_UP
+};
+
+// how a TCP client connects to its server again after losing it
+struct ReconnectOptions {
+	// how long in milliseconds to wait before the second attempt. The first is made straight away
+	unsigned int initialDelay;
+	// each wait is multiplier times as long as the one before, but never more than maxDelay milliseconds
+	double multiplier;
+	unsigned int maxDelay;
+	// how much of each wait is random, from 0 for none to 1 for anywhere between nothing and the full wait,
+	// so clients that lost the same server don't all come back to it at once
+	double jitter;
+	// how long in milliseconds one connect(2) may take before it is given up on
+	unsigned int connectTimeout;
+	// how many attempts in a row may fail before the connection stops trying, or 0 to never stop
+	unsigned int maxAttempts;
+
+	ReconnectOptions(const unsigned int &initialDelay = 100, const double &multiplier = 2, const unsigned int &maxDelay = 5000, const double &jitter = 0.2, const unsigned int &connectTimeout = 3000, const unsigned int &maxAttempts = 0);
+};
+
+class NetworkConnection;
+
+// is told each time a TCP client's connection changes state, with how many attempts have been made since it was
+// last connected, and the errno it was lost or the attempt failed with, or 0
+typedef std::function<void(NetworkConnection *, const ConnectionState &, const unsigned int &, const int &)> ConnectionStateCallback;
+#endif
 
 class NetworkConnection : public CommConnection {
     protected:
 #if defined(__linux__) || defined(__linux) || defined(linux) 
         int mSocket, clientSocket;
-        struct sockaddr_in mAddr, rAddr;
+        // a client's server, or a server's own address, and who a UDP connection last heard from
+        SocketAddress mAddr, rAddr;
+        // what a client was asked to connect to, which is resolved again through Resolver each time it reconnects
+        std::string host;
+        int hostPort;
 #elif defined(_WIN32)
         SOCKET mSocket, clientSocket;
         struct addrinfo *result;
@@ -46,23 +144,212 @@ class NetworkConnection : public CommConnection {
 #endif
         int connectionType;
         bool server;
+#if defined(__linux__) || defined(__linux) || defined(linux) 
+        // what is written to buffer ahead of each datagram's payload in datagram mode
+        struct DatagramHeader {
+            uint32_t length;
+            SocketAddress source;
+        };
 
-        bool setupServer(const int &port);
+        // whether UDP reads are kept as whole datagrams in buffer, each behind a DatagramHeader
+        bool datagrams;
+        int batchSize, datagramSize;
+        // what recvmmsg(2) receives into before the datagrams are copied into buffer
+        std::vector<char> batchData;
+        std::vector<struct mmsghdr> batchHeaders;
+        std::vector<struct iovec> batchIovs;
+        std::vector<SocketAddress> batchAddrs;
+
+        // receives a batch of datagrams with recvmmsg(2) and writes as many as fit into regions
+        int getDatagrams(BufferRegion *regions, const int &regionCount);
+        // copies the oldest datagram in buffer into datagram and consumes it. Returns false if there isn't one
+        bool readDatagram(Datagram &datagram);
+        // set once UDP_SEGMENT has failed in a way that says the kernel or the device can't segment, so writeDatagrams(1)
+        // stops trying it on kernels that don't have it
+        bool gsoUnsupported;
+        // the largest segment the path to mtuDestination can carry, kept for the last destination segmentLimit(2) was asked about
+        SocketAddress mtuDestination;
+        size_t mtuLimit;
+        bool mtuKnown;
+
+        // returns whether a and b have the same length and destination, so they can be segments of one send
+        static bool sameShape(const OutgoingDatagram &a, const OutgoingDatagram &b);
+        // sends count datagrams with sendmmsg(2), returning how many were sent or -1 if none could be
+        int sendBatch(const OutgoingDatagram *datagrams, const int &count);
+        // sends count datagrams of the same length to the same place as one UDP_SEGMENT send
+        // returns how many were sent, or -1 if none could be
+        int sendSegmented(const OutgoingDatagram *datagrams, const int &count);
+        // returns where datagram is sent to
+        const SocketAddress &destinationOf(const OutgoingDatagram &datagram) const;
+        // returns the largest payload that fits in the path MTU to destination, as a connected scratch socket sees it
+        // the kernel won't segment into anything bigger. It is looked up again if refresh is set or destination changed
+        size_t segmentLimit(const SocketAddress &destination, const bool &refresh = false);
+        // returns whether datagram may be a segment of a UDP_SEGMENT send
+        bool canSegment(const OutgoingDatagram &datagram);
+
+        // only read or changed with writeMutex held
+        WriteMode writeMode;
+        // holds what write(2) queued until writeThread sends it. The threads calling write(2) are its producer
+        // and writeThread is its consumer, so it is only allocated when writeMode isn't WRITE_DIRECT
+        RingBuffer outbound;
+        // serialises the threads that call write(2), since outbound only allows one producer
+        std::mutex writeMutex;
+        // notified when data is queued for writeThread, when it has sent some, and when it stops
+        std::condition_variable writeCv;
+        // sends what is in outbound by running performWrites(). It is started by the first queued write
+        std::thread *writeThread;
+        // stopWriting asks writeThread to send what is left and stop, and stays set until setWriteMode(2) has changed
+        // outbound, so queued writes wait to see which mode they go out in. writing is set while writeThread runs
+        bool stopWriting, writing;
+        // how far outbound's position() was when writeThread last threw away data it couldn't send, and when flush(1) last returned
+        size_t discardedTo, flushedTo;
+
+        // sends count buffers from iov in as few calls as it can, waiting for room in the socket when it is full
+        // iov is advanced past what was sent. Returns how many bytes were sent, or -1 if none were and sending failed
+        // stops early if closeThread() wakes it
+        // flags are added to the ones sendmsg(2) is always called with
+        ssize_t sendAll(struct iovec *iov, int count, const int &flags = 0);
+        // copies buff into outbound, waiting for room if it is full, and starts writeThread if it isn't running
+        // sends the rest directly if writeMode becomes WRITE_DIRECT while it waits. Called with lk holding writeMutex
+        bool queueWrite(std::unique_lock<std::mutex> &lk, const char *buff, const int &buffSize);
+        // sends everything in outbound with one writev(2) at a time until stopWriter() is called
+        // is the function executed by writeThread
+        void performWrites();
+        // has writeThread send what is left in outbound and waits for it to stop, leaving stopWriting set
+        void stopWriter();
+
+        // a buffer given to writeZeroCopy(2) that the kernel may still be sending from
+        struct ZeroCopyBuffer {
+            unsigned long long id;
+            // the buffer was sent in the sends numbered start to end-1, so it is done once the kernel has finished end of them
+            uint32_t start, end;
+            // whether the kernel said it copied the data of any of those sends, as it does over loopback
+            bool copied;
+        };
+
+        bool zeroCopy;
+        ZeroCopyCallback zeroCopyCallback;
+        // guards the completion state below, since the reader and the user can both reap completions
+        std::mutex zeroCopyMutex;
+        std::deque<ZeroCopyBuffer> zeroCopyPending;
+        // how many MSG_ZEROCOPY sends have been made, and how many of them the kernel has finished with
+        // they wrap around the same way as the counter the kernel numbers its completions with
+        uint32_t zeroCopySends, zeroCopyDone;
+        // how many buffers writeZeroCopy(2) has been given, and how many of them the kernel has finished with
+        unsigned long long zeroCopyBuffers, zeroCopyRetired;
+        // the first and last numbers of sends the kernel said it copied before writeZeroCopy(2) added their buffer
+        std::deque<std::pair<uint32_t, uint32_t> > zeroCopyCopiedRanges;
+
+        // returns whether the sends numbered first to last are any of the ones buffer was sent in
+        static bool zeroCopyOverlaps(const ZeroCopyBuffer &buffer, const uint32_t &first, const uint32_t &last);
+
+        // reads the completions the kernel has put on the socket's error queue, retires the buffers they finish,
+        // and tells zeroCopyCallback about them. Returns how many buffers were retired
+        int reapZeroCopy();
+
+        ReconnectOptions reconnectOptions;
+        ConnectionStateCallback stateCallback;
+        // what setNoDelay(1) and setCork(1) last set, so they can be set again on the socket a reconnect makes
+        bool noDelay, corked;
+        // the state rand_r(1) keeps for the jitter in reconnect waits
+        unsigned int jitterSeed;
+
+        // starts a non blocking connect(2) to each address host resolves to in turn, on a new socket each time, and waits
+        // for each one in poll(2) for at most connectTimeout. mAddr is set to the address that was connected to
+        // returns the connected socket, or -1 with errno set if every address failed or terminate() interrupted it
+        int attemptConnect();
+        // makes one non blocking connect(2) to address as attemptConnect() describes, returning the socket or -1
+        int connectTo(const SocketAddress &address);
+        // sets what the user chose on the old socket on fd, which is about to replace it
+        void restoreSocketOptions(const int &fd);
+        // tells stateCallback about the connection's new state, if there is a callback
+        void reportState(const ConnectionState &state, const unsigned int &attempt, const int &error);
+#endif
+
+        // binds to bindAddress, or to every IPv6 and IPv4 address if it is empty
+        bool setupServer(const int &port, const char *bindAddress);
+        // resolves ipaddr, which may be a name or a numeric IPv4 or IPv6 address, and connects to it
         bool setupClient(const char *ipaddr, const int &port);
         bool waitForClientConnection();
         bool connectToServer();
 
         void failedRead();
         int getData(char *buff, const int &buffSize);
+#if defined(__linux__) || defined(__linux) || defined(linux) 
+        int getData(BufferRegion *regions, const int &regionCount);
+        int getFileDescriptor() const;
+        void setReadThreshold(const int &bytes);
+        // only TCP outside of datagram mode, since UDP reads also record who sent the data
+        bool readsInPlace() const;
+        // a TCP client connects to its server again when a reactor loses it
+        bool reconnectsWhenLost() const;
+#endif
         void exitGracefully();
         bool setBlocking(const int &blockingTime = -1);
     public:
-        NetworkConnection(const int &port, const int &connectionType = SOCK_STREAM, const char *ipaddr = "", const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false);
+        // a client if ipaddr is given, otherwise a server. On Linux, ipaddr may be a name or a numeric IPv4 or IPv6 address,
+        // and a server listens on both IPv6 and IPv4 unless bindAddress says which address to listen on
+        NetworkConnection(const int &port, const int &connectionType = SOCK_STREAM, const char *ipaddr = "", const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false, const BufferOptions &bufferOptions = BufferOptions(_BUFFER_SIZE), const char *bindAddress = "");
+#if defined(__linux__) || defined(__linux) || defined(linux) 
+        // wraps a TCP client that was already accepted, like the ones NetworkServer hands out
+        // there is no listening socket behind it, so when the client goes away the connection stays disconnected
+        NetworkConnection(const int &clientSocket, const SocketAddress &clientAddr, const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false, const BufferOptions &bufferOptions = BufferOptions(_BUFFER_SIZE));
+#endif
         NetworkConnection(const NetworkConnection &other);
         ~NetworkConnection();
         NetworkConnection &operator=(const NetworkConnection &other);
         using CommConnection::write;
+#if defined(__linux__) || defined(__linux) || defined(linux) 
+        // keeps each UDP datagram whole, along with who sent it, instead of adding its bytes to the stream
+        // datagrams are received batchSize at a time with recvmmsg(2) and are truncated to datagramSize bytes
+        // they must then be read with readDatagram(3) or readDatagrams(2), since buffer holds them as records
+        // returns false and does nothing if this isn't a UDP connection or begin() has already been called
+        bool useDatagrams(const bool &datagrams = true, const int &batchSize = _DATAGRAM_BATCH, const int &datagramSize = _DATAGRAM_SIZE);
+        // copies the oldest datagram into buff and consumes it, setting source to who sent it if source isn't NULL
+        // returns how many bytes were copied, which is at most buffSize, or -1 if no datagram is waiting
+        int readDatagram(char *buff, const int &buffSize, SocketAddress *source = NULL);
+        // fills up to count datagrams, oldest first, and returns how many were filled
+        int readDatagrams(Datagram *datagrams, const int &count);
+        // sends each of datagrams as its own UDP datagram, batching them into as few syscalls as possible
+        // runs of datagrams that share a length and destination are sent with UDP generic segmentation offload
+        // returns how many were sent, which is less than all of them if the socket would block, or -1 on error
+        int writeDatagrams(const std::vector<OutgoingDatagram> &datagrams);
+        // chooses how write(2) sends over TCP. The default is WRITE_DIRECT
+        // the queued modes hand writes to writeThread, which coalesces everything queued while it was busy into one writev(2)
+        // queueSize is how many bytes can be queued before write(2) waits for room
+        // anything already queued is sent first. Returns false if this isn't a TCP connection or the queue can't be made
+        bool setWriteMode(const WriteMode &mode, const size_t &queueSize = _WRITE_QUEUE_SIZE);
+        // waits until everything write(2) queued so far has been sent, or for at most timeout milliseconds if timeout isn't negative
+        // returns false if it timed out, or if queued data had to be thrown away because sending failed since the last flush
+        bool flush(const int &timeout = -1);
+        // sets TCP_NODELAY, which sends small writes straight away instead of waiting to fill a segment
+        bool setNoDelay(const bool &noDelay = true);
+        // sets TCP_CORK, which holds back partial segments until it is cleared. Clearing it sends what was held back
+        bool setCork(const bool &cork = true);
+        // sets SO_ZEROCOPY so writeZeroCopy(2) can send from the caller's memory instead of copying it into the kernel
+        // callback is told about each buffer once it may be reused. It is called from whichever thread reaps the
+        // completion, which may be the reading thread or one that is in writeZeroCopy(2), so it must not write to the connection
+        // returns false if this isn't a TCP connection or the kernel can't do it
+        bool useZeroCopy(const bool &zeroCopy = true, const ZeroCopyCallback &callback = ZeroCopyCallback());
+        // sends length bytes from buff with MSG_ZEROCOPY, which only pays off for payloads of tens of kilobytes or more
+        // buff must not be changed or freed until the kernel is done with it, as told by the callback or zeroCopyCompleted()
+        // returns the buffer's id, counting up from 0, or -1 if it couldn't all be sent
+        // a buffer that was partly sent still takes an id and is reported when it is done
+        // only allowed when writeMode is WRITE_DIRECT, so it can't overtake queued writes
+        long long writeZeroCopy(const char *buff, const size_t &length);
+        // reaps the completions the kernel has queued and returns how many buffers it is done with
+        // buffers are done in the order they were sent, so every id less than this may be reused
+        unsigned long long zeroCopyCompleted();
+        // chooses how a TCP client connects to its server again when it loses it, and has callback told about each attempt
+        // the reading thread reconnects, backing off between attempts as options say, and terminate() interrupts it
+        // a connection read by an IoReactor or UringReactor is reconnected on a thread of its own, so the reactor goes on
+        // reading its other connections, and the new socket is handed back to the reactor once it is connected
+        // data in buffer is kept across the reconnect
+        // returns false if this isn't a TCP client
+        bool setReconnect(const ReconnectOptions &options, const ConnectionStateCallback &callback = ConnectionStateCallback());
+#endif
 
+        // on Linux, returns false unless all of buff was sent over TCP, or was queued if writeMode isn't WRITE_DIRECT
         bool write(const char *buff, const int &buffSize);
 };
 
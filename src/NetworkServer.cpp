@@ -0,0 +1,91 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#if defined(__linux__) || defined(__linux) || defined(linux)
+    #include "Linux/NetworkServer.cpp"
+#elif defined(_WIN32)
+    #include "Windows/NetworkServer.cpp"
+#else
+    #error Unsupported os
+#endif
+
+// protected:
+void NetworkServer::deliver(NetworkConnection *session) {
+	if(callback) {
+		callback(session);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lk(sessionMutex);
+		sessions.push_back(session);
+	}
+	sessionCv.notify_one();
+}
+
+// public:
+NetworkServer::NetworkServer(const int &port, const int &acceptorCount, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : bufferOptions(bufferOptions) {
+	this->port = port;
+	this->acceptorCount = acceptorCount > 0 ? acceptorCount : 1;
+	this->blockingTime = blockingTime;
+	this->debug = debug;
+	this->noReads = noReads;
+	pinned = false;
+	begun = false;
+	interruptAccept = false;
+	wakeFd = -1;
+}
+
+bool NetworkServer::setSessionCallback(const SessionCallback &callback) {
+	if(begun) {
+		return false;
+	}
+	this->callback = callback;
+	return true;
+}
+
+bool NetworkServer::pinAcceptors(const bool &pin) {
+	if(begun) {
+		return false;
+	}
+	pinned = pin;
+	return true;
+}
+
+bool NetworkServer::setBindAddress(const std::string &address) {
+	if(begun) {
+		return false;
+	}
+	bindAddress = address;
+	return true;
+}
+
+NetworkConnection *NetworkServer::waitForSession(const int &timeout) {
+	std::unique_lock<std::mutex> lk(sessionMutex);
+	auto ready = [this]{ return this->interruptAccept || !this->sessions.empty(); };
+	if(timeout < 0) {
+		sessionCv.wait(lk, ready);
+	} else {
+		sessionCv.wait_for(lk, std::chrono::milliseconds(timeout), ready);
+	}
+	if(sessions.empty()) {
+		return NULL;
+	}
+	NetworkConnection *session = sessions.front();
+	sessions.pop_front();
+	return session;
+}
+
+size_t NetworkServer::pendingSessions() {
+	std::lock_guard<std::mutex> lk(sessionMutex);
+	return sessions.size();
+}
+
+bool NetworkServer::isListening() const {
+	return begun && !interruptAccept;
+}
+
+NetworkServer::~NetworkServer() {
+	terminate();
+}
@@ -0,0 +1,83 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+#ifndef NETWORKSERVER_H
+#define NETWORKSERVER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <string>
+#include "NetworkConnection.h"
+
+// called from an acceptor thread with each client a NetworkServer accepts
+// the callback owns the connection, which hasn't been begun yet, and must delete it when it is done with it
+typedef std::function<void(NetworkConnection *)> SessionCallback;
+
+// A TCP server that serves many clients at once, handing each one out as its own NetworkConnection.
+// Each acceptor thread listens on its own SO_REUSEPORT socket bound to the same port, so the kernel spreads new
+// clients across them. Clients go to the session callback if there is one and are queued for waitForSession()
+// otherwise. Only available on Linux.
+class NetworkServer {
+protected:
+	int port, acceptorCount;
+	// the address the listening sockets are bound to, or empty for every IPv6 and IPv4 address
+	std::string bindAddress;
+	// the settings every accepted connection is made with
+	int blockingTime;
+	bool debug, noReads;
+	BufferOptions bufferOptions;
+	// whether acceptor i is pinned to core i, wrapping around the cores there are
+	bool pinned;
+	bool begun;
+	std::atomic<bool> interruptAccept;
+	// an eventfd(2) that wakes the acceptors so they can see that interruptAccept is set
+	int wakeFd;
+	// one listening socket per acceptor
+	std::vector<int> listenSockets;
+	std::vector<std::thread *> acceptors;
+	SessionCallback callback;
+	// accepted connections waiting for waitForSession() when there is no callback
+	std::deque<NetworkConnection *> sessions;
+	std::mutex sessionMutex;
+	std::condition_variable sessionCv;
+
+	// opens a non blocking socket that listens on bindAddress and port alongside the other acceptors, or returns -1
+	int openListener();
+	// accepts clients on listenSockets[index] until terminate() is called
+	// is the function executed by each of acceptors
+	void performAccepts(const int &index);
+	// gives a newly accepted connection to the callback or the queue
+	void deliver(NetworkConnection *session);
+public:
+	// nothing is accepted until begin() is called
+	NetworkServer(const int &port, const int &acceptorCount = 1, const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false, const BufferOptions &bufferOptions = BufferOptions(_BUFFER_SIZE));
+	~NetworkServer();
+
+	// sets the function accepted connections are given to. Must be called before begin()
+	bool setSessionCallback(const SessionCallback &callback);
+	// pins acceptor i to core i so accepting stays on the cores the kernel steers the clients to. Must be called before begin()
+	bool pinAcceptors(const bool &pin = true);
+	// listens only on address, a name or a numeric IPv4 or IPv6 address, instead of on every address. Must be called before begin()
+	bool setBindAddress(const std::string &address);
+	// opens the listening sockets and starts the acceptor threads
+	bool begin();
+	// stops accepting and deletes any connections still in the queue. Connections already handed out are left alone
+	void terminate();
+	// returns the oldest queued connection, waiting up to timeout milliseconds for one, or forever if timeout is negative
+	// returns NULL if there wasn't one in time or the server was terminated. The caller owns the connection
+	NetworkConnection *waitForSession(const int &timeout = -1);
+	// returns how many accepted connections are waiting in the queue
+	size_t pendingSessions();
+	// returns whether the acceptors are running
+	bool isListening() const;
+};
+
+#endif // NETWORKSERVER_H
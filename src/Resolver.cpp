@@ -0,0 +1,132 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "Resolver.h"
+#include <cstring>
+
+std::mutex Resolver::mutex;
+std::condition_variable Resolver::cv;
+std::map<std::string, Resolver::Entry> Resolver::cache;
+unsigned int Resolver::ttl = _RESOLVER_TTL;
+
+// protected:
+int Resolver::lookUp(const std::string &host, const int &socketType, std::vector<SocketAddress> &addresses) {
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = socketType;
+	// a numeric address is taken as it is, even in a family only loopback has an address in
+	hints.ai_flags = AI_NUMERICHOST;
+	struct addrinfo *result = NULL;
+	int error = getaddrinfo(host.c_str(), NULL, &hints, &result);
+	if(error != 0) {
+		// only ask for the families this host has an address in, so a connection doesn't try IPv6 without a route for it
+		hints.ai_flags = AI_ADDRCONFIG;
+		error = getaddrinfo(host.c_str(), NULL, &hints, &result);
+	}
+	if(error != 0) {
+		return error;
+	}
+	addresses.clear();
+	for(struct addrinfo *info = result; info != NULL; info = info->ai_next) {
+		if((info->ai_family != AF_INET && info->ai_family != AF_INET6) || info->ai_addrlen > sizeof(SocketAddress)) {
+			continue;
+		}
+		SocketAddress address;
+		memset(&address, 0, sizeof(address));
+		memcpy(&address, info->ai_addr, info->ai_addrlen);
+		addresses.push_back(address);
+	}
+	freeaddrinfo(result);
+	return addresses.empty() ? EAI_NONAME : 0;
+}
+
+// public:
+int Resolver::resolve(const std::string &host, const int &port, const int &socketType, std::vector<SocketAddress> &addresses) {
+	// the socket type is part of the key, since getaddrinfo(3) answers per type
+	std::string key = host+(socketType == SOCK_DGRAM ? "/dgram" : "/stream");
+	std::unique_lock<std::mutex> lk(mutex);
+	bool waited = false;
+	while(true) {
+		std::map<std::string, Entry>::iterator found = cache.find(key);
+		if(found == cache.end()) {
+			break;
+		} else if(found->second.resolving) {
+			cv.wait(lk);
+			waited = true;
+		} else if(found->second.error != 0 && waited) {
+			// the lookup this waited for failed, and asking again straight away would only fail the same way
+			return found->second.error;
+		} else if(found->second.error == 0 && std::chrono::steady_clock::now() < found->second.expires) {
+			addresses = found->second.addresses;
+			for(size_t i = 0; i < addresses.size(); i++) {
+				setPort(addresses[i], port);
+			}
+			return 0;
+		} else {
+			cache.erase(found);
+			break;
+		}
+	}
+	cache[key].resolving = true;
+	lk.unlock();
+	std::vector<SocketAddress> looked;
+	int error = lookUp(host, socketType, looked);
+	lk.lock();
+	Entry &entry = cache[key];
+	entry.resolving = false;
+	entry.error = error;
+	entry.addresses = looked;
+	entry.expires = std::chrono::steady_clock::now()+std::chrono::milliseconds(ttl);
+	cv.notify_all();
+	if(error != 0) {
+		// the threads that waited for this lookup see the error, and the next one to come along tries again
+		return error;
+	}
+	addresses = looked;
+	for(size_t i = 0; i < addresses.size(); i++) {
+		setPort(addresses[i], port);
+	}
+	return 0;
+}
+
+void Resolver::setTtl(const unsigned int &milliseconds) {
+	std::lock_guard<std::mutex> lk(mutex);
+	ttl = milliseconds;
+}
+
+void Resolver::clear() {
+	std::lock_guard<std::mutex> lk(mutex);
+	// lookups in progress are left for the threads waiting on them
+	std::map<std::string, Entry>::iterator entry = cache.begin();
+	while(entry != cache.end()) {
+		if(entry->second.resolving) {
+			entry++;
+		} else {
+			cache.erase(entry++);
+		}
+	}
+}
+
+socklen_t Resolver::length(const SocketAddress &address) {
+	return address.sa.sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+void Resolver::setPort(SocketAddress &address, const int &port) {
+	if(address.sa.sa_family == AF_INET6) {
+		address.v6.sin6_port = htons(port);
+	} else {
+		address.v4.sin_port = htons(port);
+	}
+}
+
+bool Resolver::equal(const SocketAddress &a, const SocketAddress &b) {
+	if(a.sa.sa_family != b.sa.sa_family) {
+		return false;
+	} else if(a.sa.sa_family == AF_INET6) {
+		return a.v6.sin6_port == b.v6.sin6_port && memcmp(&a.v6.sin6_addr, &b.v6.sin6_addr, sizeof(a.v6.sin6_addr)) == 0;
+	}
+	return a.v4.sin_port == b.v4.sin_port && a.v4.sin_addr.s_addr == b.v4.sin_addr.s_addr;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	#include <sys/types.h>
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+	#include <netdb.h>
+#elif defined(_WIN32)
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+#else
+	#error Unsupported os
+#endif
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// default for how many milliseconds Resolver reuses the addresses it looked up
+#define _RESOLVER_TTL 30000
+
+// an IPv4 or IPv6 socket address, whichever sa.sa_family says it is
+union SocketAddress {
+	struct sockaddr sa;
+	struct sockaddr_in v4;
+	struct sockaddr_in6 v6;
+};
+
+// Looks up host names with getaddrinfo(3) and remembers the answers for a while, so many connections to the same host
+// share one lookup. A lookup that is already in progress is waited for rather than repeated, so connections started
+// all at once don't each ask the name server. getaddrinfo(3) doesn't say how long its answers are good for, so they
+// are kept for the same ttl, which setTtl(1) chooses. Failed lookups aren't kept. All of the functions are thread safe.
+class Resolver {
+protected:
+	// what is known about one host and socket type
+	struct Entry {
+		std::vector<SocketAddress> addresses;
+		std::chrono::steady_clock::time_point expires;
+		// set while a thread is looking the host up, which the others wait for on cv
+		bool resolving;
+		// what getaddrinfo(3) returned the last time the host was looked up
+		int error;
+	};
+
+	static std::mutex mutex;
+	// notified whenever a lookup finishes
+	static std::condition_variable cv;
+	static std::map<std::string, Entry> cache;
+	static unsigned int ttl;
+
+	// asks getaddrinfo(3) where host is, without a port, and fills addresses in the order it prefers them
+	// returns 0 or the error getaddrinfo(3) returned
+	static int lookUp(const std::string &host, const int &socketType, std::vector<SocketAddress> &addresses);
+public:
+	// fills addresses with where host, a name or a numeric IPv4 or IPv6 address, can be reached on port with sockets of
+	// socketType, most preferred first. Only families the system has an address for are returned
+	// returns 0, or the getaddrinfo(3) error if host couldn't be resolved, which gai_strerror(3) describes
+	static int resolve(const std::string &host, const int &port, const int &socketType, std::vector<SocketAddress> &addresses);
+	// sets how many milliseconds a lookup is reused for. 0 looks every host up every time
+	static void setTtl(const unsigned int &milliseconds);
+	// forgets every lookup, so the next resolve(4) of each host asks again
+	static void clear();
+	// returns how long address is for the family it is in, as bind(2), connect(2), and sendto(2) want it
+	static socklen_t length(const SocketAddress &address);
+	// sets the port of address, whichever family it is in
+	static void setPort(SocketAddress &address, const int &port);
+	// returns whether a and b are the same family, address, and port
+	static bool equal(const SocketAddress &a, const SocketAddress &b);
+};
+
+#endif // RESOLVER_H
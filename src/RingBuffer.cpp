@@ -0,0 +1,596 @@
+#include "RingBuffer.h"
+#include <cstdio>
+#include <errno.h>
+#include <stdint.h>
+#include <new>
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	#include <unistd.h>
+	#include <sys/mman.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#include <immintrin.h>
+	#define _RINGBUFFER_X86_SIMD
+#endif
+
+#ifdef _RINGBUFFER_X86_SIMD
+// compares 32 bytes at a time. Only called when the processor reports AVX2 support
+__attribute__((target("avx2")))
+static const char *findByteAvx2(const char *begin, const char *end, const char &target) {
+	__m256i needle = _mm256_set1_epi8(target);
+	for(; end-begin >= 32; begin += 32) {
+		unsigned int matches = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) begin), needle));
+		if(matches != 0) {
+			return begin+__builtin_ctz(matches);
+		}
+	}
+	for(; begin != end; begin++) {
+		if(*begin == target) {
+			return begin;
+		}
+	}
+	return end;
+}
+
+// compares 16 bytes at a time
+__attribute__((target("sse2")))
+static const char *findByteSse2(const char *begin, const char *end, const char &target) {
+	__m128i needle = _mm_set1_epi8(target);
+	for(; end-begin >= 16; begin += 16) {
+		unsigned int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) begin), needle));
+		if(matches != 0) {
+			return begin+__builtin_ctz(matches);
+		}
+	}
+	for(; begin != end; begin++) {
+		if(*begin == target) {
+			return begin;
+		}
+	}
+	return end;
+}
+
+static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+#endif
+
+// returns a pointer to the first target in [begin, end) or end if there isn't one
+static const char *findByte(const char *begin, const char *end, const char &target) {
+#ifdef _RINGBUFFER_X86_SIMD
+	if(hasAvx2) {
+		return findByteAvx2(begin, end, target);
+	}
+	return findByteSse2(begin, end, target);
+#else
+	for(; begin != end; begin++) {
+		if(*begin == target) {
+			return begin;
+		}
+	}
+	return end;
+#endif
+}
+
+BufferOptions::BufferOptions(const size_t &initialSize, const size_t &minSize, const size_t &maxSize, const bool &mirrored, const bool &hugePages) {
+	this->initialSize = initialSize;
+	this->minSize = minSize;
+	this->maxSize = maxSize;
+	this->mirrored = mirrored;
+	this->hugePages = hugePages;
+}
+
+// protected
+RingBuffer::Storage *RingBuffer::allocateStorage(const size_t &capacity, const bool &mirrored, const bool &hugePages) {
+	Storage *storage = new Storage;
+	storage->capacity = capacity;
+	storage->mirrored = false;
+	storage->mapping = NULL;
+	storage->mappingLength = 0;
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	bool huge = hugePages && capacity >= _HUGE_PAGE_SIZE;
+	if(mirrored) {
+		if(storage->capacity < pageSize) {
+			storage->capacity = pageSize;
+		}
+		size_t alignment = pageSize;
+		int fd = -1;
+		if(huge) {
+			fd = memfd_create("RingBuffer", MFD_CLOEXEC | MFD_HUGETLB);
+			alignment = _HUGE_PAGE_SIZE;
+		}
+		if(fd < 0 || ftruncate(fd, storage->capacity) != 0) {
+			if(fd >= 0) {
+				close(fd);
+			}
+			fd = memfd_create("RingBuffer", MFD_CLOEXEC);
+			alignment = pageSize;
+		}
+		if(fd >= 0 && ftruncate(fd, storage->capacity) == 0) {
+			// reserve the space for both views first, aligned to the page size, so nothing else can be mapped between them
+			size_t length = 2*storage->capacity+alignment;
+			char *reserved = (char *) mmap(NULL, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if(reserved != MAP_FAILED) {
+				char *aligned = (char *) (((uintptr_t) reserved+alignment-1) & ~((uintptr_t) alignment-1));
+				void *first = mmap(aligned, storage->capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+				void *second = mmap(&aligned[storage->capacity], storage->capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+				if(first == aligned && second == &aligned[storage->capacity]) {
+					close(fd);
+					storage->data = aligned;
+					storage->mask = storage->capacity-1;
+					storage->mirrored = true;
+					storage->mapping = reserved;
+					storage->mappingLength = length;
+					return storage;
+				}
+				munmap(reserved, length);
+			}
+		}
+		fprintf(stderr, "Could not map a mirrored buffer, errno %d. Using a normal one instead.\n", errno);
+		if(fd >= 0) {
+			close(fd);
+		}
+	}
+	void *mapping = MAP_FAILED;
+	if(huge) {
+		mapping = mmap(NULL, storage->capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+	if(mapping == MAP_FAILED) {
+		// anonymous pages are only backed by memory once they are touched, so an idle buffer costs next to nothing
+		mapping = mmap(NULL, storage->capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mapping != MAP_FAILED && hugePages) {
+			madvise(mapping, storage->capacity, MADV_HUGEPAGE);
+		}
+	}
+	if(mapping != MAP_FAILED) {
+		storage->data = (char *) mapping;
+		storage->mask = storage->capacity-1;
+		storage->mapping = mapping;
+		storage->mappingLength = storage->capacity;
+		return storage;
+	}
+#endif
+	storage->data = new (std::nothrow) char[storage->capacity];
+	if(storage->data == NULL) {
+		fprintf(stderr, "Could not allocate a buffer of %lu bytes.\n", (unsigned long) storage->capacity);
+		delete storage;
+		return NULL;
+	}
+	storage->mask = storage->capacity-1;
+	return storage;
+}
+
+void RingBuffer::releaseStorage(Storage *storage) {
+	if(storage == NULL) {
+		return;
+	}
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	if(storage->mapping != NULL) {
+		munmap(storage->mapping, storage->mappingLength);
+		delete storage;
+		return;
+	}
+#endif
+	delete[] storage->data;
+	delete storage;
+}
+
+size_t RingBuffer::roundUp(const size_t &size) {
+	size_t rounded = 1;
+	while(rounded < size) {
+		rounded <<= 1;
+	}
+	return rounded;
+}
+
+void RingBuffer::copyOut(const Storage *storage, char *buff, const size_t &index, const size_t &length) {
+	if(length == 0) {
+		return;
+	}
+	size_t start = index & storage->mask;
+	size_t firstPart = storage->capacity-start;
+	if(storage->mirrored || length <= firstPart) {
+		memcpy(buff, &storage->data[start], length);
+	} else {
+		memcpy(buff, &storage->data[start], firstPart);
+		memcpy(&buff[firstPart], storage->data, length-firstPart);
+	}
+}
+
+void RingBuffer::copyIn(Storage *storage, const char *buff, const size_t &index, const size_t &length) {
+	if(length == 0) {
+		return;
+	}
+	size_t start = index & storage->mask;
+	size_t firstPart = storage->capacity-start;
+	if(storage->mirrored || length <= firstPart) {
+		memcpy(&storage->data[start], buff, length);
+	} else {
+		memcpy(&storage->data[start], buff, firstPart);
+		memcpy(storage->data, &buff[firstPart], length-firstPart);
+	}
+}
+
+RingBuffer::Storage *RingBuffer::consumerStorage() {
+	if(hasRetired.load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> lk(retiredMutex);
+		for(size_t i = 0; i < retired.size(); i++) {
+			releaseStorage(retired[i]);
+		}
+		retired.clear();
+		hasRetired.store(false, std::memory_order_relaxed);
+	}
+	return storage.load(std::memory_order_acquire);
+}
+
+bool RingBuffer::resize(const size_t &capacity) {
+	Storage *current = storage.load(std::memory_order_relaxed);
+	Storage *replacement = allocateStorage(capacity, options.mirrored, options.hugePages);
+	if(replacement == NULL) {
+		return false;
+	} else if(replacement->capacity == current->capacity) {
+		releaseStorage(replacement);
+		return false;
+	}
+	// the unread data keeps its indexes, it is just masked differently in the new storage
+	size_t currentHead = head.load(std::memory_order_relaxed);
+	cachedTail = tail.load(std::memory_order_acquire);
+	for(size_t index = cachedTail; index != currentHead;) {
+		size_t start = index & current->mask;
+		size_t length = current->capacity-start;
+		if(length > currentHead-index) {
+			length = currentHead-index;
+		}
+		copyIn(replacement, &current->data[start], index, length);
+		index += length;
+	}
+	storage.store(replacement, std::memory_order_release);
+	std::lock_guard<std::mutex> lk(retiredMutex);
+	retired.push_back(current);
+	hasRetired.store(true, std::memory_order_release);
+	return true;
+}
+
+size_t RingBuffer::unreadAfter(const size_t &currentTail, const size_t &wanted) {
+	// when the producer can drop data, tail may have been moved past cachedHead
+	if(producerDrops || cachedHead-currentTail < wanted) {
+		cachedHead = head.load(std::memory_order_acquire);
+	}
+	return cachedHead-currentTail;
+}
+
+bool RingBuffer::advanceTail(size_t &currentTail, const size_t &newTail) {
+	if(!producerDrops) {
+		tail.store(newTail, std::memory_order_release);
+		currentTail = newTail;
+		return true;
+	} else if(tail.compare_exchange_strong(currentTail, newTail, std::memory_order_acq_rel, std::memory_order_acquire)) {
+		currentTail = newTail;
+		return true;
+	}
+	return false;
+}
+
+void RingBuffer::releaseAll() {
+	std::lock_guard<std::mutex> lk(retiredMutex);
+	for(size_t i = 0; i < retired.size(); i++) {
+		releaseStorage(retired[i]);
+	}
+	retired.clear();
+	hasRetired.store(false, std::memory_order_relaxed);
+	releaseStorage(storage.load(std::memory_order_relaxed));
+	storage.store(NULL, std::memory_order_relaxed);
+}
+
+// public
+RingBuffer::RingBuffer(const BufferOptions &options) : storage(NULL), hasRetired(false), producerDrops(false), head(0), cachedTail(0), tail(0), cachedHead(0) {
+	reset(options);
+}
+
+RingBuffer::RingBuffer(const RingBuffer &other) : storage(NULL), hasRetired(false), producerDrops(false), head(0), cachedTail(0), tail(0), cachedHead(0) {
+	*this = other;
+}
+
+RingBuffer &RingBuffer::operator=(const RingBuffer &other) {
+	if(this == &other) {
+		return *this;
+	}
+	reset(other.options);
+	producerDrops = other.producerDrops;
+	Storage *otherStorage = other.storage.load(std::memory_order_acquire);
+	if(otherStorage != NULL) {
+		Storage *copy = allocateStorage(otherStorage->capacity, options.mirrored, options.hugePages);
+		if(copy != NULL) {
+			size_t otherTail = other.tail.load(std::memory_order_acquire);
+			size_t otherHead = other.head.load(std::memory_order_acquire);
+			for(size_t index = otherTail; index != otherHead;) {
+				size_t start = index & otherStorage->mask;
+				size_t length = otherStorage->capacity-start;
+				if(length > otherHead-index) {
+					length = otherHead-index;
+				}
+				copyIn(copy, &otherStorage->data[start], index, length);
+				index += length;
+			}
+			storage.store(copy, std::memory_order_relaxed);
+			tail.store(otherTail, std::memory_order_relaxed);
+			head.store(otherHead, std::memory_order_release);
+			cachedTail = otherTail;
+			cachedHead = otherHead;
+		}
+	}
+	return *this;
+}
+
+RingBuffer::~RingBuffer() {
+	releaseAll();
+}
+
+void RingBuffer::reset(const BufferOptions &options) {
+	releaseAll();
+	this->options = options;
+	this->options.initialSize = roundUp(options.initialSize);
+	this->options.minSize = options.minSize == 0 ? this->options.initialSize : roundUp(options.minSize);
+	this->options.maxSize = options.maxSize == 0 ? this->options.initialSize : roundUp(options.maxSize);
+	if(this->options.minSize > this->options.initialSize) {
+		this->options.minSize = this->options.initialSize;
+	}
+	if(this->options.maxSize < this->options.initialSize) {
+		this->options.maxSize = this->options.initialSize;
+	}
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	// a mirror has to be made of whole pages
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	if(this->options.mirrored && this->options.minSize < pageSize) {
+		this->options.minSize = pageSize;
+		if(this->options.initialSize < pageSize) {
+			this->options.initialSize = pageSize;
+		}
+		if(this->options.maxSize < pageSize) {
+			this->options.maxSize = pageSize;
+		}
+	}
+#endif
+	head.store(0, std::memory_order_relaxed);
+	tail.store(0, std::memory_order_relaxed);
+	cachedTail = 0;
+	cachedHead = 0;
+}
+
+bool RingBuffer::allocate() {
+	if(storage.load(std::memory_order_relaxed) == NULL) {
+		storage.store(allocateStorage(options.initialSize, options.mirrored, options.hugePages), std::memory_order_release);
+	}
+	return isAllocated();
+}
+
+void RingBuffer::allowProducerDrops(const bool &allow) {
+	producerDrops = allow;
+}
+
+bool RingBuffer::isAllocated() const {
+	return storage.load(std::memory_order_acquire) != NULL;
+}
+
+const BufferOptions &RingBuffer::getOptions() const {
+	return options;
+}
+
+size_t RingBuffer::size() const {
+	Storage *current = storage.load(std::memory_order_acquire);
+	return current == NULL ? 0 : current->capacity;
+}
+
+bool RingBuffer::isMirrored() const {
+	Storage *current = storage.load(std::memory_order_acquire);
+	return current != NULL && current->mirrored;
+}
+
+BufferRegion RingBuffer::storageRegion() const {
+	Storage *current = storage.load(std::memory_order_acquire);
+	BufferRegion region;
+	region.data = current != NULL ? current->data : NULL;
+	region.length = current == NULL ? 0 : current->mirrored ? 2*current->capacity : current->capacity;
+	return region;
+}
+
+size_t RingBuffer::available() const {
+	size_t currentTail = tail.load(std::memory_order_acquire);
+	return head.load(std::memory_order_acquire)-currentTail;
+}
+
+size_t RingBuffer::freeSpace() {
+	Storage *current = storage.load(std::memory_order_relaxed);
+	if(current == NULL) {
+		return 0;
+	}
+	size_t currentHead = head.load(std::memory_order_relaxed);
+	size_t space = current->capacity-(currentHead-cachedTail);
+	if(space == 0) {
+		cachedTail = tail.load(std::memory_order_acquire);
+		space = current->capacity-(currentHead-cachedTail);
+	}
+	return space;
+}
+
+size_t RingBuffer::write(const char *buff, const size_t &length) {
+	Storage *current = storage.load(std::memory_order_relaxed);
+	if(current == NULL) {
+		return 0;
+	}
+	size_t currentHead = head.load(std::memory_order_relaxed);
+	size_t space = current->capacity-(currentHead-cachedTail);
+	if(space < length) {
+		cachedTail = tail.load(std::memory_order_acquire);
+		space = current->capacity-(currentHead-cachedTail);
+	}
+	size_t toWrite = length < space ? length : space;
+	if(toWrite > 0) {
+		copyIn(current, buff, currentHead, toWrite);
+		head.store(currentHead+toWrite, std::memory_order_release);
+	}
+	return toWrite;
+}
+
+int RingBuffer::writeRegions(BufferRegion regions[2]) {
+	Storage *current = storage.load(std::memory_order_relaxed);
+	if(current == NULL) {
+		return 0;
+	}
+	// a read system call usually follows, so it is worth refreshing cachedTail to offer all of the free space
+	cachedTail = tail.load(std::memory_order_acquire);
+	size_t currentHead = head.load(std::memory_order_relaxed);
+	size_t unread = currentHead-cachedTail;
+	if(unread == current->capacity && current->capacity < options.maxSize) {
+		if(resize(current->capacity*2)) {
+			current = storage.load(std::memory_order_relaxed);
+		}
+	} else if(unread < current->capacity/8 && current->capacity > options.minSize) {
+		if(resize(current->capacity/2)) {
+			current = storage.load(std::memory_order_relaxed);
+		}
+	}
+	size_t space = current->capacity-unread;
+	if(space == 0) {
+		return 0;
+	}
+	size_t start = currentHead & current->mask;
+	size_t firstPart = current->capacity-start;
+	regions[0].data = &current->data[start];
+	if(current->mirrored || space <= firstPart) {
+		regions[0].length = space;
+		return 1;
+	}
+	regions[0].length = firstPart;
+	regions[1].data = current->data;
+	regions[1].length = space-firstPart;
+	return 2;
+}
+
+void RingBuffer::commitWrite(const size_t &length) {
+	head.store(head.load(std::memory_order_relaxed)+length, std::memory_order_release);
+}
+
+size_t RingBuffer::writePosition() const {
+	return head.load(std::memory_order_relaxed);
+}
+
+size_t RingBuffer::dropTo(const size_t &index) {
+	size_t currentTail = tail.load(std::memory_order_acquire);
+	while(currentTail < index) {
+		if(tail.compare_exchange_weak(currentTail, index, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			cachedTail = index;
+			return index-currentTail;
+		}
+	}
+	cachedTail = currentTail;
+	return 0;
+}
+
+char RingBuffer::at(const size_t &offset) {
+	size_t currentTail = tail.load(std::memory_order_acquire);
+	unreadAfter(currentTail, offset+1);
+	Storage *current = consumerStorage();
+	return current->data[(currentTail+offset) & current->mask];
+}
+
+bool RingBuffer::read(char *buff, const size_t &length) {
+	size_t currentTail = tail.load(std::memory_order_acquire);
+	do {
+		if(unreadAfter(currentTail, length) < length) {
+			return false;
+		} else if(length == 0) {
+			return true;
+		}
+		copyOut(consumerStorage(), buff, currentTail, length);
+	} while(!advanceTail(currentTail, currentTail+length));
+	return true;
+}
+
+size_t RingBuffer::readSome(char *buff, const size_t &length) {
+	size_t currentTail = tail.load(std::memory_order_acquire);
+	size_t toRead;
+	do {
+		size_t unread = unreadAfter(currentTail, length);
+		toRead = length < unread ? length : unread;
+		if(toRead == 0) {
+			return 0;
+		}
+		copyOut(consumerStorage(), buff, currentTail, toRead);
+	} while(!advanceTail(currentTail, currentTail+toRead));
+	return toRead;
+}
+
+int RingBuffer::peek(BufferSpan spans[2]) {
+	size_t currentTail = tail.load(std::memory_order_acquire);
+	cachedHead = head.load(std::memory_order_acquire);
+	size_t unread = cachedHead-currentTail;
+	if(unread == 0) {
+		return 0;
+	}
+	Storage *current = consumerStorage();
+	size_t start = currentTail & current->mask;
+	size_t firstPart = current->capacity-start;
+	spans[0].data = &current->data[start];
+	if(current->mirrored || unread <= firstPart) {
+		spans[0].length = unread;
+		return 1;
+	}
+	spans[0].length = firstPart;
+	spans[1].data = current->data;
+	spans[1].length = unread-firstPart;
+	return 2;
+}
+
+bool RingBuffer::find(const char &delim, size_t &offset, const size_t &limit) {
+	BufferSpan spans[2];
+	int spanCount = peek(spans);
+	size_t spanStart = 0;
+	for(int i = 0; i < spanCount && offset < limit; i++) {
+		size_t spanEnd = spanStart+spans[i].length;
+		if(offset < spanEnd) {
+			const char *begin = &spans[i].data[offset-spanStart];
+			const char *end = &spans[i].data[(limit < spanEnd ? limit : spanEnd)-spanStart];
+			const char *found = findByte(begin, end, delim);
+			offset += found-begin;
+			if(found != end) {
+				return true;
+			}
+		}
+		spanStart = spanEnd;
+	}
+	return false;
+}
+
+bool RingBuffer::copyAt(const size_t &index, char *buff, const size_t &length) {
+	size_t currentTail = tail.load(std::memory_order_acquire);
+	if(index < currentTail || unreadAfter(currentTail, index-currentTail+length) < index-currentTail+length) {
+		return false;
+	}
+	copyOut(consumerStorage(), buff, index, length);
+	return true;
+}
+
+bool RingBuffer::consumeAt(const size_t &index, const size_t &length) {
+	size_t currentTail = tail.load(std::memory_order_acquire);
+	if(currentTail != index || unreadAfter(currentTail, length) < length) {
+		return false;
+	}
+	return advanceTail(currentTail, index+length);
+}
+
+size_t RingBuffer::position() const {
+	return tail.load(std::memory_order_acquire);
+}
+
+void RingBuffer::consume(const size_t &length) {
+	size_t currentTail = tail.load(std::memory_order_acquire);
+	size_t unread = unreadAfter(currentTail, length);
+	size_t target = currentTail+(length < unread ? length : unread);
+	// if the producer dropped past target there is nothing left to do
+	while(currentTail < target && !advanceTail(currentTail, target));
+}
+
+void RingBuffer::clear() {
+	size_t currentTail = tail.load(std::memory_order_acquire);
+	cachedHead = head.load(std::memory_order_acquire);
+	while(currentTail < cachedHead && !advanceTail(currentTail, cachedHead));
+}
@@ -0,0 +1,177 @@
+#pragma once
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// size of a cache line on the processors this library targets
+#define _CACHE_LINE_SIZE 64
+// size of a huge page on the processors this library targets
+#define _HUGE_PAGE_SIZE 2097152
+
+// a contiguous piece of a RingBuffer's storage
+struct BufferRegion {
+	char *data;
+	size_t length;
+};
+
+// a read only view of unread data in a RingBuffer
+struct BufferSpan {
+	const char *data;
+	size_t length;
+};
+
+// how a RingBuffer's storage is sized and allocated. Sizes are rounded up to powers of two
+struct BufferOptions {
+	// the capacity the buffer is allocated with
+	size_t initialSize;
+	// the buffer doubles when it is full and halves when it is mostly empty, but never leaves these bounds
+	// if they are 0 they are taken to be initialSize, so by default the buffer never changes size
+	size_t minSize, maxSize;
+	// maps the storage twice in a row so every unread and free region is contiguous
+	bool mirrored;
+	// backs the storage with huge pages when the system has them to spare, otherwise with normal pages
+	bool hugePages;
+
+	BufferOptions(const size_t &initialSize = 0, const size_t &minSize = 0, const size_t &maxSize = 0, const bool &mirrored = false, const bool &hugePages = false);
+};
+
+// A lock free, single producer, single consumer circular buffer.
+// Only the producer (the reading thread) may call the producer functions and only one consumer (the user) may call the
+// consumer functions. head and tail only ever increase and are masked into data, so capacity is always a power of two.
+// A mirrored RingBuffer maps the same pages twice in a row, so data[capacity+i] is data[i] and any unread or free
+// region is contiguous. It is only available on Linux and falls back to a normal allocation when it can't be made.
+// Storage is not allocated until allocate() is called. When the buffer is resized, the producer copies the unread data
+// into new storage and retires the old one, which the consumer frees the next time it reads.
+class RingBuffer {
+protected:
+	// the memory the buffer lives in. It is replaced as a whole when the buffer is resized
+	struct Storage {
+		char *data;
+		size_t capacity, mask;
+		bool mirrored;
+		// the mmap(2)ed range that holds data, or NULL if data came from new[]
+		void *mapping;
+		size_t mappingLength;
+	};
+
+	BufferOptions options;
+	// only the producer replaces storage. The consumer loads it after head, so it is never older than the data it reads
+	std::atomic<Storage *> storage;
+	// storage that was replaced while the consumer may have still been reading from it
+	std::vector<Storage *> retired;
+	std::atomic<bool> hasRetired;
+	std::mutex retiredMutex;
+	// whether the producer may move tail with dropTo(1), which makes the consumer advance tail with compare and swap
+	bool producerDrops;
+	char producerPadding[_CACHE_LINE_SIZE];
+	// written by the producer, read by the consumer
+	std::atomic<size_t> head;
+	// the producer's last known value of tail, so it doesn't have to touch the consumer's cache line on every write
+	size_t cachedTail;
+	char consumerPadding[_CACHE_LINE_SIZE];
+	// written by the consumer, read by the producer
+	std::atomic<size_t> tail;
+	// the consumer's last known value of head
+	size_t cachedHead;
+	char endPadding[_CACHE_LINE_SIZE];
+
+	// allocates storage for capacity bytes, or returns NULL if it can't
+	static Storage *allocateStorage(const size_t &capacity, const bool &mirrored, const bool &hugePages);
+	static void releaseStorage(Storage *storage);
+	// returns the smallest power of two that is at least size
+	static size_t roundUp(const size_t &size);
+	// copies length bytes starting at the index into buff, splitting the copy if it wraps around the end of data
+	static void copyOut(const Storage *storage, char *buff, const size_t &index, const size_t &length);
+	// copies length bytes from buff into data starting at the index
+	static void copyIn(Storage *storage, const char *buff, const size_t &index, const size_t &length);
+	// frees all retired storage and returns the current storage. Only called by the consumer
+	Storage *consumerStorage();
+	// moves the unread data into new storage of capacity bytes. Only called by the producer
+	bool resize(const size_t &capacity);
+	// frees all storage, current and retired
+	void releaseAll();
+	// returns how many bytes are unread past currentTail, only loading head if cachedHead doesn't cover wanted bytes
+	size_t unreadAfter(const size_t &currentTail, const size_t &wanted);
+	// moves tail from currentTail to newTail. Fails and sets currentTail to tail if the producer dropped data meanwhile
+	bool advanceTail(size_t &currentTail, const size_t &newTail);
+public:
+	// the storage is not allocated until allocate() is called
+	RingBuffer(const BufferOptions &options = BufferOptions());
+	RingBuffer(const RingBuffer &other);
+	RingBuffer &operator=(const RingBuffer &other);
+	~RingBuffer();
+
+	// discards all the data and storage and takes on the new options. Neither side may be using the buffer
+	void reset(const BufferOptions &options);
+	// allocates storage as described by the options if it hasn't been already, and returns whether there is storage
+	bool allocate();
+	// lets the producer drop unread data with dropTo(1). Must be set before either side uses the buffer
+	// when it is set, data seen through peek(1), at(1), or find(3) may be dropped and overwritten while it is looked at
+	void allowProducerDrops(const bool &allow);
+	// returns whether the buffer has storage
+	bool isAllocated() const;
+	// returns the options the buffer was made with
+	const BufferOptions &getOptions() const;
+	// returns the number of bytes data can currently hold
+	size_t size() const;
+	// returns whether the storage is mapped twice so that every region is contiguous
+	bool isMirrored() const;
+	// returns the memory data lives in, which is twice size() long when it is mirrored, or an empty region if there is none
+	// it is replaced when the producer resizes the buffer, so only the producer can rely on it
+	BufferRegion storageRegion() const;
+	// returns how many bytes the consumer can read
+	size_t available() const;
+
+	// producer functions
+	// returns how many bytes can be written without overwriting unread data
+	size_t freeSpace();
+	// copies up to length bytes of buff into the buffer and returns how many were copied
+	// bytes that do not fit are not written so unread data is never overwritten
+	size_t write(const char *buff, const size_t &length);
+	// fills regions with the free space so it can be written to in place and returns how many regions were filled
+	// there are 2 regions when the free space wraps around the end of data and 0 when the buffer is full
+	// a full buffer is grown first if maxSize allows it, and a mostly empty one is shrunk toward minSize
+	int writeRegions(BufferRegion regions[2]);
+	// makes length bytes that were written in place through writeRegions() available to the consumer
+	void commitWrite(const size_t &length);
+	// returns how many bytes have been written since the buffer was created or reset
+	size_t writePosition() const;
+	// discards the unread data before the index, as counted by writePosition(), and returns how many bytes that was
+	// only allowed if allowProducerDrops(1) was set
+	size_t dropTo(const size_t &index);
+
+	// consumer functions
+	// returns the byte that is offset bytes past the oldest unread byte. offset must be less than available()
+	char at(const size_t &offset);
+	// copies length bytes into buff and consumes them if that many are available
+	// returns false and leaves buff untouched otherwise
+	bool read(char *buff, const size_t &length);
+	// copies up to length bytes into buff and consumes them, returning how many were copied
+	size_t readSome(char *buff, const size_t &length);
+	// fills spans with the unread data without consuming it and returns how many spans were filled
+	// there are 2 spans when the unread data wraps around the end of data and 0 when there is nothing to read
+	// the spans stay valid until the next call to peek(1) or to any of the functions that read data
+	int peek(BufferSpan spans[2]);
+	// looks for delim in the unread data, starting offset bytes past the oldest unread byte and stopping at limit
+	// returns true and sets offset to where delim is if it is found, otherwise sets offset to how far it looked
+	bool find(const char &delim, size_t &offset, const size_t &limit);
+	// copies the length bytes at the index, as counted by position(), into buff without consuming them
+	// returns false if any of those bytes aren't unread
+	bool copyAt(const size_t &index, char *buff, const size_t &length);
+	// consumes the length bytes at the index, as counted by position(), if the index is still the oldest unread byte
+	// so data copied with copyAt(3) can be consumed only if the producer didn't drop it in the meantime
+	bool consumeAt(const size_t &index, const size_t &length);
+	// returns how many bytes have been consumed since the buffer was created or reset
+	size_t position() const;
+	// discards length bytes, or everything that is available if there is less than that
+	void consume(const size_t &length);
+	// discards all the unread data
+	void clear();
+};
+
+#endif // RINGBUFFER_H
@@ -11,6 +11,15 @@
     #error Unsupported os
 #endif
 
+SerialOptions::SerialOptions(const unsigned int &baudRate, const int &parity, const unsigned char &minBytes, const unsigned char &interByteTimeout, const bool &lowLatency, const bool &syncWrites) {
+    this->baudRate = baudRate;
+    this->parity = parity;
+    this->minBytes = minBytes;
+    this->interByteTimeout = interByteTimeout;
+    this->lowLatency = lowLatency;
+    this->syncWrites = syncWrites;
+}
+
 SerialConnection::~SerialConnection() {
     terminate();
 }
@@ -13,6 +13,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
 
 #elif defined(_WIN32)
 
@@ -25,24 +28,60 @@
 #include <cstdio>
 #include "CommConnection.h"
 
+// how a SerialConnection sets up its port
+struct SerialOptions {
+	// the speed in bits per second. Rates that have no B constant, like 3000000 or 12000000, are allowed
+	unsigned int baudRate;
+	// PARENB, PARENB | PARODD, or 0 for no parity
+	int parity;
+	// VMIN, how many bytes a read waits for once the port is readable, up to 255. The size of a frame has reads return whole frames
+	// terminate() waits for a read in progress, so interByteTimeout should be set when this is more than 1
+	unsigned char minBytes;
+	// VTIME, how long in tenths of a second a read waits for another byte before returning what it has
+	// 0 has a read wait for minBytes however long it takes
+	unsigned char interByteTimeout;
+	// sets ASYNC_LOW_LATENCY, which asks the driver to hand data over as soon as it arrives instead of batching it
+	// for FTDI adapters it drops the latency timer from 16ms to 1ms. Ports that don't have it are left as they are
+	bool lowLatency;
+	// opens the port with O_SYNC, so write(2) doesn't return until the driver has sent the data
+	bool syncWrites;
+
+	SerialOptions(const unsigned int &baudRate = 115200, const int &parity = 0, const unsigned char &minBytes = 1, const unsigned char &interByteTimeout = 0, const bool &lowLatency = false, const bool &syncWrites = false);
+};
+
 class SerialConnection : public CommConnection {
 protected:
 #if defined(__linux__) || defined(__linux) || defined(linux)
 	int ser;
-	int set_interface_attribs (const int &speed, const int &parity); 
+	// puts the port in raw mode. speed is a B constant, or -1 to leave the speed as it is
+	int set_interface_attribs (const int &speed, const int &parity, const int &minBytes = 0, const int &interByteTimeout = 5);
 	int set_blocking (const bool &should_block);
+	// sets the port to baudRate bits per second through termios2 and BOTHER, so it doesn't need a B constant
+	bool setBaudRate(const unsigned int &baudRate);
+	// turns ASYNC_LOW_LATENCY on or off. Returns false if the driver doesn't have it
+	bool setLowLatencyMode(const bool &lowLatency);
 #elif defined(_WIN32)
 	HANDLE handler;    
+	// opens portName at baudRate bits per second, 8N1
+	void openPort(const char *portName, const DWORD &baudRate);
 #else
 #error Unsupported os
 #endif
 
 	void failedRead();
 	int getData(char *buff, const int &buffSize);
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	int getData(BufferRegion *regions, const int &regionCount);
+	int getFileDescriptor() const;
+#endif
 	void exitGracefully();
 	bool setBlocking(const int &blockingTime = -1);
 public:
-	SerialConnection(const char *portName, const int &speed, const int &parity, const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false);
+	// speed is a B constant, like B57600. The port is opened with O_SYNC and reads wait up to half a second for data
+	SerialConnection(const char *portName, const int &speed, const int &parity, const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false, const BufferOptions &bufferOptions = BufferOptions(_BUFFER_SIZE));
+	// sets the port up as options says, at any baud rate the device can do
+	// the port is opened non blocking unless blockingTime is -1
+	SerialConnection(const char *portName, const SerialOptions &options, const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false, const BufferOptions &bufferOptions = BufferOptions(_BUFFER_SIZE));
 	SerialConnection(const SerialConnection &other);
 	SerialConnection &operator=(const SerialConnection &other);
 	~SerialConnection();
@@ -0,0 +1,130 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "SerialGroup.h"
+#include <chrono>
+
+// protected:
+void SerialGroup::watch(const size_t &index) {
+	SerialConnection *port = ports[index];
+	if(port->watchFor(1, -1, [this, index](CommConnection *) { arrived(index); })) {
+		// the data is already there, or the port has stopped reading, in which case it isn't watched any more
+		if(port->available() > 0) {
+			readyPorts.push_back(index);
+		}
+	}
+}
+
+void SerialGroup::arrived(const size_t &index) {
+	{
+		std::lock_guard<std::mutex> lk(mutex);
+		if(!begun) {
+			return;
+		}
+		readyPorts.push_back(index);
+	}
+	readyCv.notify_all();
+}
+
+// public:
+SerialGroup::SerialGroup(const int &threadCount, const bool &debug) : reactor(threadCount, debug) {
+	this->debug = debug;
+	begun = false;
+}
+
+SerialGroup::~SerialGroup() {
+	terminate();
+}
+
+int SerialGroup::add(const char *portName, const SerialOptions &options, const BufferOptions &bufferOptions) {
+	// a blockingTime of 0 opens the port non blocking, so the reactor can read it until it runs dry
+	SerialConnection *port = new SerialConnection(portName, options, 0, debug, false, bufferOptions);
+	if(!port->isConnected()) {
+		delete port;
+		return -1;
+	}
+	std::lock_guard<std::mutex> lk(mutex);
+	if(begun && !port->begin(&reactor)) {
+		fprintf(stderr, "Could not start reading %s\n", portName);
+		delete port;
+		return -1;
+	}
+	ports.push_back(port);
+	if(begun) {
+		watch(ports.size()-1);
+	}
+	return ports.size()-1;
+}
+
+bool SerialGroup::begin() {
+	std::lock_guard<std::mutex> lk(mutex);
+	if(begun || !reactor.begin()) {
+		return false;
+	}
+	begun = true;
+	for(size_t i = 0; i < ports.size(); i++) {
+		if(ports[i]->begin(&reactor)) {
+			watch(i);
+		} else {
+			fprintf(stderr, "Could not start reading port %lu\n", (unsigned long) i);
+		}
+	}
+	return true;
+}
+
+void SerialGroup::terminate() {
+	std::vector<SerialConnection *> stopping;
+	{
+		std::lock_guard<std::mutex> lk(mutex);
+		begun = false;
+		stopping.swap(ports);
+		readyPorts.clear();
+		handedOut.clear();
+	}
+	readyCv.notify_all();
+	// the ports are deleted without mutex held, since terminating one fires its watch, which takes mutex
+	for(size_t i = 0; i < stopping.size(); i++) {
+		delete stopping[i];
+	}
+	reactor.terminate();
+}
+
+size_t SerialGroup::size() {
+	std::lock_guard<std::mutex> lk(mutex);
+	return ports.size();
+}
+
+SerialConnection *SerialGroup::port(const size_t &index) {
+	std::lock_guard<std::mutex> lk(mutex);
+	return index < ports.size() ? ports[index] : NULL;
+}
+
+size_t SerialGroup::waitForAny(std::vector<size_t> &ready, const int &timeout) {
+	ready.clear();
+	std::unique_lock<std::mutex> lk(mutex);
+	// the caller has had its chance to drain these, so they are watched for the next data
+	for(size_t i = 0; i < handedOut.size(); i++) {
+		watch(handedOut[i]);
+	}
+	handedOut.clear();
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now()+std::chrono::milliseconds(timeout);
+	while(ready.empty() && begun) {
+		if(timeout < 0) {
+			readyCv.wait(lk, [this]{ return !this->readyPorts.empty() || !this->begun; });
+		} else if(!readyCv.wait_until(lk, end, [this]{ return !this->readyPorts.empty() || !this->begun; })) {
+			break;
+		}
+		while(!readyPorts.empty()) {
+			size_t index = readyPorts.front();
+			readyPorts.pop_front();
+			// a port that stopped reading fires its watch without data, and is left out from then on
+			if(index < ports.size() && ports[index]->available() > 0) {
+				ready.push_back(index);
+				handedOut.push_back(index);
+			}
+		}
+	}
+	return ready.size();
+}
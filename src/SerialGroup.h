@@ -0,0 +1,67 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+#ifndef SERIALGROUP_H
+#define SERIALGROUP_H
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <deque>
+#include "IoReactor.h"
+#include "SerialConnection.h"
+
+// default size of each port's buffer in a SerialGroup, which is much smaller than _BUFFER_SIZE since there are many ports
+// 65536 = 2^16 = 64KB
+#define _SERIAL_GROUP_BUFFER_SIZE 65536
+
+// Many serial ports read by a few IoReactor threads instead of a thread each.
+// The ports are opened non blocking and polled with epoll(7), and what is read from each one goes into that port's
+// own buffer, where it is read through the SerialConnection as usual. waitForAny(2) waits for any of them to have data.
+// The group owns its ports and deletes them when it is terminated. Only available on Linux.
+class SerialGroup {
+protected:
+	IoReactor reactor;
+	bool debug;
+	bool begun;
+	// a port's index is where it is in ports
+	std::vector<SerialConnection *> ports;
+	// guards ports and the ready lists
+	std::mutex mutex;
+	// notified when a port is added to readyPorts, or the group is terminated
+	std::condition_variable readyCv;
+	// the ports that have had data arrive since the last waitForAny(2), oldest first
+	std::deque<size_t> readyPorts;
+	// the ports the last waitForAny(2) returned, which are watched again by the next one
+	std::vector<size_t> handedOut;
+
+	// has the port at index be put in readyPorts once it has data. Called with mutex held
+	void watch(const size_t &index);
+	// puts the port at index in readyPorts. Called by a reactor thread when a watch fires
+	void arrived(const size_t &index);
+public:
+	// reads with threadCount reactor threads once begin() is called
+	SerialGroup(const int &threadCount = 1, const bool &debug = false);
+	~SerialGroup();
+
+	// opens portName as options says, without blocking, and adds it to the group. It is read from straight away if
+	// the group has begun. Returns the port's index, or -1 if it couldn't be opened
+	int add(const char *portName, const SerialOptions &options, const BufferOptions &bufferOptions = BufferOptions(_SERIAL_GROUP_BUFFER_SIZE));
+	// starts the reactor threads and reading from every port. A group can't be begun again after it is terminated
+	bool begin();
+	// stops reading and deletes every port
+	void terminate();
+	// returns how many ports are in the group
+	size_t size();
+	// returns the port at index, or NULL if there isn't one. It belongs to the group
+	SerialConnection *port(const size_t &index);
+	// blocks until at least one port has unread data, or for at most timeout milliseconds if timeout isn't negative
+	// fills ready with the indices of those ports and returns how many there are. A port that isn't drained before the
+	// next call is returned again. Only one thread may call this at a time
+	size_t waitForAny(std::vector<size_t> &ready, const int &timeout = -1);
+};
+
+#endif // SERIALGROUP_H
@@ -0,0 +1,141 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+#ifndef SHAREDMEMORYCONNECTION_H
+#define SHAREDMEMORYCONNECTION_H
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <linux/futex.h>
+    #include <errno.h>
+    #include <stdint.h>
+#elif defined(_WIN32)
+    #include <windows.h>
+#else
+    #error Unsupported os
+#endif
+
+#include <cstdio>
+#include <string>
+#include "CommConnection.h"
+
+// default size of the ring each side writes into
+// 1048576 = 2^20 = 1MB
+#define _SHM_RING_SIZE 1048576
+// how long the side that opens the segment waits between attempts to find it, in milliseconds
+#define _SHM_RETRY_DELAY 1000
+// how often a side that is parked on a futex checks whether the other process has died, in milliseconds
+#define _SHM_PEER_CHECK 500
+// marks a segment that was made by this library and is ready to be used
+#define _SHM_MAGIC 0x434f4d4d53484d31ULL
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+// one direction of a SharedMemoryConnection, as it is laid out in the shared segment
+// head and tail only ever increase and are masked into the data, like in RingBuffer
+struct SharedRing {
+	// written by the producer
+	std::atomic<uint64_t> head;
+	// the futex the consumer sleeps on. The producer only bumps it and wakes it if consumerParked is set
+	std::atomic<uint32_t> dataSeq;
+	std::atomic<uint32_t> consumerParked;
+	char producerPadding[_CACHE_LINE_SIZE-16];
+	// written by the consumer
+	std::atomic<uint64_t> tail;
+	// the futex the producer sleeps on when the ring is full. The consumer only wakes it if producerParked is set
+	std::atomic<uint32_t> spaceSeq;
+	std::atomic<uint32_t> producerParked;
+	char consumerPadding[_CACHE_LINE_SIZE-16];
+};
+
+// what is at the start of the shared segment. The data of rings[0] and then rings[1] follow it, capacity bytes each
+struct SharedSegment {
+	// set last by the side that makes the segment, once everything else is ready
+	std::atomic<uint64_t> magic;
+	uint64_t capacity;
+	// the process of each side, or 0 if that side hasn't attached
+	std::atomic<int32_t> pids[2];
+	// set by a side when it is terminated
+	std::atomic<uint32_t> closed[2];
+	char padding[_CACHE_LINE_SIZE-32];
+	SharedRing rings[2];
+};
+#endif
+
+// A connection between two processes on the same host through a named POSIX shared memory segment.
+// The segment holds a ring for each direction. write(2) copies straight into the other side's ring without a syscall,
+// and the reader copies out of its ring into buffer, so the rest of the CommConnection API works as it does for
+// any other connection. A side only makes a futex(2) call to wake the other when the other is parked waiting,
+// and only parks itself once there is nothing to read, after spinning for LowLatencyOptions::spinMicros.
+// One side makes the segment and the other opens it, retrying until it exists. Only one of each can use a segment,
+// and the connection ends for good when either side is terminated or its process dies.
+// There is no file descriptor to poll, so it can't be begun with an IoReactor. Only available on Linux.
+class SharedMemoryConnection : public CommConnection {
+protected:
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	// the name of the segment, starting with '/'
+	std::string name;
+	// whether this side made the segment, and so removes it when it is terminated
+	bool creator;
+	// this side writes to segment->rings[side] and reads from the other ring
+	int side;
+	int shmFd;
+	SharedSegment *segment;
+	size_t segmentSize;
+	// the size of each ring, a power of two
+	size_t capacity;
+	SharedRing *incoming, *outgoing;
+	char *incomingData, *outgoingData;
+	// keeps writes from several threads from interleaving, since a ring only has one producer
+	std::mutex writeMutex;
+
+	// waits on word until it no longer holds value, it is woken, or timeout milliseconds pass if timeout isn't negative
+	// returns false if it timed out
+	static bool futexWait(std::atomic<uint32_t> *word, const uint32_t &value, const int &timeout);
+	// wakes everything waiting on word
+	static void futexWake(std::atomic<uint32_t> *word);
+	// makes the segment, replacing one that was left by a side that is gone
+	bool createSegment(const size_t &ringSize);
+	// opens the segment, trying again every _SHM_RETRY_DELAY milliseconds until it exists or this is terminated
+	bool openSegment();
+	// maps the segment from shmFd and points the rings at it
+	bool mapSegment(const size_t &size);
+	// returns whether the other side has been terminated, or if checkProcess is set, whether its process has died
+	bool peerGone(const bool &checkProcess) const;
+	// waits until incoming holds more than tail, returning its head, or tail if the wait was interrupted or the peer is gone
+	uint64_t awaitIncoming(const uint64_t &tail);
+	// waits until outgoing has room past head. Returns false if the peer is gone or this is being terminated
+	bool awaitSpace(const uint64_t &head);
+	void wakeReader();
+	int getData(BufferRegion *regions, const int &regionCount);
+	bool readsInPlace() const;
+#endif
+
+	void failedRead();
+	int getData(char *buff, const int &buffSize);
+	void exitGracefully();
+	bool setBlocking(const int &blockingTime = -1);
+public:
+	// makes the segment called name if create is set, otherwise waits for it to be made and opens it
+	// ringSize is only used by the side that makes it. Check isConnected() to see whether it worked
+	SharedMemoryConnection(const char *name, const bool &create, const size_t &ringSize = _SHM_RING_SIZE, const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false, const BufferOptions &bufferOptions = BufferOptions(_BUFFER_SIZE));
+	// the copy maps the segment again, and uses the same side of it
+	SharedMemoryConnection(const SharedMemoryConnection &other);
+	SharedMemoryConnection &operator=(const SharedMemoryConnection &other);
+	~SharedMemoryConnection();
+	// returns whether the other side has opened the segment
+	bool isPeerAttached() const;
+	using CommConnection::write;
+	// copies buff into the other side's ring, waiting for room if it is full
+	// returns false and sets errno if the other side is gone
+	bool write(const char *buff, const int &buffSize);
+};
+
+#endif // SHAREDMEMORYCONNECTION_H
@@ -0,0 +1,91 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+#ifndef UNIXCONNECTION_H
+#define UNIXCONNECTION_H
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/uio.h>
+    #include <sys/un.h>
+    #include <errno.h>
+#elif defined(_WIN32)
+    #include <windows.h>
+#else
+    #error Unsupported os
+#endif
+
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include "CommConnection.h"
+
+// how long a client waits between attempts to connect to a server that isn't listening yet, in milliseconds
+#define _UNIX_RETRY_DELAY 1000
+
+// A connection over a Unix domain socket, for processes on the same host that don't need the TCP/IP stack between them.
+// socketType is SOCK_STREAM, SOCK_DGRAM or SOCK_SEQPACKET. A path that starts with '@' is in the abstract namespace,
+// which has no file and goes away with the last socket bound to it. Otherwise a server removes a socket file left at
+// path by a server before it, and removes its own when it is terminated.
+// A stream or seqpacket server waits in the constructor for one client, and for the next one when that client leaves,
+// like a TCP NetworkConnection does. A client keeps trying to connect until it does or is terminated.
+// A datagram server answers whoever it last heard from, and a datagram client is bound to an abstract address the
+// kernel picks so it can be answered. Messages are put in the buffer back to back, and a message longer than the free
+// space in the buffer is cut short, as with UDP. Only available on Linux.
+class UnixConnection : public CommConnection {
+protected:
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	// the socket bound to path for a server, or connected to it for a client
+	int mSocket;
+	// the client a stream or seqpacket server accepted, or -1
+	int clientSocket;
+	int socketType;
+	bool server;
+	std::string path;
+	// the address path stands for, and how much of it is used
+	struct sockaddr_un mAddr;
+	socklen_t mAddrLength;
+	// who a datagram server last heard from
+	struct sockaddr_un rAddr;
+	socklen_t rAddrLength;
+
+	// fills addr with the address path stands for. Returns false if path doesn't fit in sun_path
+	static bool makeAddress(const std::string &path, struct sockaddr_un &addr, socklen_t &length);
+	// binds to path, removing a socket file that was left there, and waits for a client if it is a stream or seqpacket
+	bool setupServer();
+	// accepts the next client on mSocket, waiting in poll(2) so terminate() can interrupt the wait
+	bool waitForClientConnection();
+	// opens a socket and connects it to path, trying again every _UNIX_RETRY_DELAY milliseconds until terminated
+	bool connectToServer();
+	int getData(BufferRegion *regions, const int &regionCount);
+	int getFileDescriptor() const;
+	// a datagram server has to read with recvmsg(2) to learn who to answer, so only it can't be read in place
+	bool readsInPlace() const;
+	// keeps writes from several threads from interleaving when one of them is only partly sent
+	std::mutex writeMutex;
+#endif
+
+	void failedRead();
+	int getData(char *buff, const int &buffSize);
+	void exitGracefully();
+	bool setBlocking(const int &blockingTime = -1);
+public:
+	// a server binds to path and a client connects to it. Check isConnected() to see whether it worked
+	UnixConnection(const char *path, const int &socketType = SOCK_STREAM, const bool &server = false, const int &blockingTime = -1, const bool &debug = false, const bool &noReads = false, const BufferOptions &bufferOptions = BufferOptions(_BUFFER_SIZE));
+	UnixConnection(const UnixConnection &other);
+	UnixConnection &operator=(const UnixConnection &other);
+	~UnixConnection();
+	using CommConnection::write;
+	// sends the whole of buff as one message for datagram and seqpacket sockets
+	// returns false and sets errno upon error
+	bool write(const char *buff, const int &buffSize);
+};
+
+#endif // UNIXCONNECTION_H
@@ -0,0 +1,181 @@
+#pragma once
+#ifndef URINGREACTOR_H
+#define URINGREACTOR_H
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include "IoReactor.h"
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	#include <sys/uio.h>
+#endif
+
+// how many submissions the io_uring(7) instance has room for. Its completion queue is twice as big
+#define _URING_ENTRIES 256
+// how many connections can have their file descriptor and buffer registered with the ring. Any more work without
+#define _URING_SLOTS 1024
+
+// is told how a write submitted with UringReactor::write(4) went, with the buffer it was given
+// and how many bytes were written, or -errno if it failed
+typedef std::function<void(CommConnection *, const char *, const int &)> UringWriteCallback;
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// An IoReactor that has the kernel do the reads and writes through io_uring(7) instead of waiting for readiness with epoll(7).
+// Each connection always has a read submitted straight into the free space of its buffer, and the submissions and
+// completions for every connection are handed over in the one io_uring_enter(2) the reactor thread waits in.
+// Connections have their file descriptor and buffer registered with the ring while there are slots for them, so the
+// kernel doesn't look up the file and pin the memory on every read. All of it is done by one thread, whatever threadCount is.
+// io_uring is driven through its syscalls directly, so nothing more needs to be linked. If it isn't available, or a
+// connection's reads can't be done in place, the connection is polled with epoll(7) by IoReactor as usual.
+// Only available on Linux.
+class UringReactor : public IoReactor {
+protected:
+	// what a submission is for, kept in the low bits of its user_data. The rest is the connection or RingWrite
+	enum Operation {
+		OP_READ,
+		// waiting for a non blocking connection to be readable after a read found nothing
+		OP_POLL,
+		OP_WRITE,
+		// waiting for a non blocking connection to be writable after a write didn't fit
+		OP_WRITE_POLL
+	};
+
+	// a write that was submitted with write(4)
+	struct RingWrite {
+		CommConnection *conn;
+		const char *data;
+		size_t length, written;
+		UringWriteCallback callback;
+	};
+
+#if defined(__linux__) || defined(__linux) || defined(linux)
+	// what the reactor knows about a connection it reads from through the ring
+	struct RingRegistration {
+		int fd;
+		// where the connection's file descriptor and buffer are in the ring's registered tables, or -1 if they aren't
+		int slot;
+		// the storage of the connection's buffer that is registered in slot, so it can be registered again after a resize
+		BufferRegion registered;
+		// sockets are written to with IORING_OP_SEND so a peer that went away doesn't raise SIGPIPE
+		bool isSocket;
+		// the connection's buffer belongs to the kernel while a read or poll is submitted
+		bool reading;
+		Operation readOperation;
+		// the buffer was full under OVERFLOW_BLOCK, so no read is submitted until resume(1)
+		bool waitingForSpace;
+		bool removing;
+		// where the submitted read goes
+		BufferRegion regions[2];
+		int regionCount;
+		struct iovec iov[2];
+		// what OVERFLOW_DROP_NEWEST reads into to throw the data away. Only allocated for that policy
+		std::vector<char> discard;
+		// the writes that haven't finished, oldest first. Only the oldest is submitted, so they can't interleave
+		std::deque<RingWrite *> writes;
+		bool writing;
+		Operation writeOperation;
+	};
+
+	bool usingRing;
+	int ringFd;
+	bool sqPoll;
+	// the rings shared with the kernel, as mmap(2)ed from ringFd
+	void *sqRing, *cqRing;
+	size_t sqRingSize, cqRingSize;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+	unsigned int sqEntries;
+	unsigned int *sqHead, *sqTail, *sqMask, *sqArray, *sqFlags;
+	unsigned int *cqHead, *cqTail, *cqMask;
+	struct io_uring_cqe *cqes;
+	// how many submissions haven't completed yet, so the reactor thread doesn't stop while the kernel has buffers
+	size_t inFlight;
+	// set between begin() and terminate(), while there is a thread to take completions
+	bool ringRunning;
+	// an eventfd(2) the ring thread always has a read submitted on, so other threads can wake it to submit for them
+	int ringWakeFd;
+	// what the read on ringWakeFd reads into. Its address is what the read's completions are told apart by
+	unsigned long long ringWakeValue;
+	// guards the submission queue and everything about the connections read through the ring
+	std::mutex ringMutex;
+	// notified whenever a connection being removed has nothing left in flight
+	std::condition_variable ringIdleCv;
+	std::map<CommConnection *, RingRegistration> ringConnections;
+	// the indices of the registered tables that no connection is using
+	std::vector<int> freeSlots;
+	std::thread *ringThread;
+
+	// makes the ring and maps it, returning false if io_uring isn't available
+	bool setupRing(const unsigned int &sqPollMillis);
+	// unmaps and closes the ring. Nothing may be in flight
+	void teardownRing();
+	// hands the submission queue to the kernel and waits for at least waitFor completions
+	// returns what io_uring_enter(2) did
+	int enter(const unsigned int &waitFor);
+	// returns the next free submission queue entry, cleared, or NULL if the kernel won't make room
+	// it isn't seen by the kernel until publish() is called. Called with ringMutex held
+	struct io_uring_sqe *getSqe();
+	// makes the entry from getSqe() visible to the kernel. Called with ringMutex held
+	void publish();
+	// submits a cancel for the submission with userData. Called with ringMutex held
+	void cancel(const unsigned long long &userData);
+	// returns whether the calling thread is ringThread. Called with ringMutex held
+	bool onRingThread() const;
+	// has what was published handed to the kernel by the ring thread, or by the kernel's own thread under sqPoll
+	// no other thread submits, since the kernel cancels what a thread submitted once that thread exits
+	// Called with ringMutex held
+	void wakeRing();
+	// submits the read on ringWakeFd. Called with ringMutex held
+	void submitWakeRead();
+	// puts fd in slot of the registered file table, or clears the slot if fd is -1
+	bool registerFile(const int &slot, const int &fd);
+	// puts storage in slot of the registered buffer table, or clears the slot if storage is empty
+	bool registerBuffer(const int &slot, const BufferRegion &storage);
+	// submits a read into the free space of conn's buffer, or leaves it waiting for space. Called with ringMutex held
+	void submitRead(CommConnection *conn, RingRegistration &registration);
+	// submits a poll for the connection to have events, after it said it would block. Called with ringMutex held
+	bool submitPoll(const unsigned long long &userData, RingRegistration &registration, const short &events);
+	// submits what is left of the oldest write. Called with ringMutex held
+	bool submitWrite(RingRegistration &registration);
+	// writes length bytes of buff to conn on the calling thread, for when the ring can't. Returns what write(4) reports
+	int writeNow(CommConnection *conn, const char *buff, const size_t &length);
+	// takes completions until terminate() is called and nothing is in flight
+	// is the function executed by ringThread
+	void runRing();
+	// handles the completion of a read or the poll before it
+	void finishRead(CommConnection *conn, const Operation &operation, const int &result);
+	// handles the completion of a write or the poll before it
+	void finishWrite(RingWrite *write, const Operation &operation, const int &result);
+	// marks conn as not connected and wakes anyone waiting for data from it, or has it reconnect
+	// called without ringMutex, since it calls the user's watch callback
+	void lose(CommConnection *conn, const int &error);
+#endif
+public:
+	// sets up the ring straight away, falling back to epoll(7) if it can't
+	// if sqPollMillis is more than 0, a kernel thread polls the submission queue so submitting doesn't take a syscall,
+	// and goes to sleep after that many milliseconds without submissions. It costs a core while it is awake
+	UringReactor(const int &threadCount = 1, const bool &debug = false, const unsigned int &sqPollMillis = 0);
+	~UringReactor();
+
+	// returns whether io_uring is being used, rather than epoll(7) for everything
+	bool isUsingUring() const;
+	bool begin();
+	// cancels every read and write in flight and waits for the kernel to give the buffers back
+	void terminate();
+	bool add(CommConnection *conn);
+	void remove(CommConnection *conn);
+	void resume(CommConnection *conn);
+	size_t size();
+	// writes length bytes of buff to conn, submitting the rest again when only part of it was written
+	// writes to the same connection go out in the order they were made. buff must stay valid until callback is called
+	// if submit is false the write waits to be handed to the kernel with the next submission, so many writes cost one syscall
+	// if conn isn't read through the ring, or the ring isn't running, the write is done on the calling thread and
+	// callback is called before this returns. Returns false if the write couldn't be submitted or failed straight away
+	bool write(CommConnection *conn, const char *buff, const size_t &length, const UringWriteCallback &callback = UringWriteCallback(), const bool &submit = true);
+	// hands every submission that is waiting to the kernel
+	void submit();
+};
+
+#endif // URINGREACTOR_H
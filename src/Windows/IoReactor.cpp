@@ -0,0 +1,48 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "../IoReactor.h"
+
+// there is no reactor on windows yet, so connections have to be begun with their own readThread
+
+// protected:
+void IoReactor::run() {
+}
+
+void IoReactor::handle(CommConnection *conn, const unsigned int &events) {
+}
+
+bool IoReactor::arm(CommConnection *conn, const int &op) {
+	return false;
+}
+
+// public:
+IoReactor::IoReactor(const int &threadCount, const bool &debug) {
+	this->threadCount = threadCount;
+	this->debug = debug;
+	epollFd = -1;
+	wakeFd = -1;
+	interrupt = false;
+	begun = false;
+}
+
+bool IoReactor::begin() {
+	fprintf(stderr, "IoReactor is not supported on this os\n");
+	return false;
+}
+
+void IoReactor::terminate() {
+}
+
+bool IoReactor::add(CommConnection *conn) {
+	fprintf(stderr, "IoReactor is not supported on this os\n");
+	return false;
+}
+
+void IoReactor::remove(CommConnection *conn) {
+}
+
+void IoReactor::resume(CommConnection *conn) {
+}
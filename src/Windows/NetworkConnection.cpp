@@ -6,7 +6,7 @@
 #include "../NetworkConnection.h"
 
 // protected
-bool NetworkConnection::setupServer(const int &port) {
+bool NetworkConnection::setupServer(const int &port, const char *bindAddress) {
     WSADATA wsaData;
     connAddr = NULL;
     struct addrinfo *ptr = NULL, hints;
@@ -26,7 +26,7 @@ bool NetworkConnection::setupServer(const int &port) {
         return false;
     }
     // Resolve the local address and port to be used by the server
-    iResult = getaddrinfo(NULL, itoa(port), &hints, &connAddr);
+    iResult = getaddrinfo(strcmp(bindAddress, "") == 0 ? NULL : bindAddress, itoa(port), &hints, &connAddr);
     if (iResult != 0) {
         printf("getaddrinfo failed: %d\n", iResult);
         WSACleanup();
@@ -46,8 +46,7 @@ void SerialConnection::exitGracefully() {
     delete[] stop;
 }
 
-// public:
-SerialConnection::SerialConnection(const char *portName, const int &blockingTime, const bool &debug, const bool &noReads) : CommConnection(blockingTime, debug, noReads) {
+void SerialConnection::openPort(const char *portName, const DWORD &baudRate) {
     handler = CreateFileA(static_cast<LPCSTR>(portName),
         GENERIC_READ | GENERIC_WRITE,
         0,
@@ -67,7 +66,7 @@ SerialConnection::SerialConnection(const char *portName, const int &blockingTime
         if (!GetCommState(handler, &dcbSerialParameters)) {
             printf("Failed to get current serial parameters");
         } else {
-            dcbSerialParameters.BaudRate = CBR_9600;
+            dcbSerialParameters.BaudRate = baudRate;
             dcbSerialParameters.ByteSize = 8;
             dcbSerialParameters.StopBits = ONESTOPBIT;
             dcbSerialParameters.Parity = NOPARITY;
@@ -84,6 +83,16 @@ SerialConnection::SerialConnection(const char *portName, const int &blockingTime
     }
 }
 
+// public:
+SerialConnection::SerialConnection(const char *portName, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : CommConnection(blockingTime, debug, noReads, bufferOptions) {
+    openPort(portName, CBR_9600);
+}
+
+// a DCB takes any baud rate, so only the rate is used from options
+SerialConnection::SerialConnection(const char *portName, const SerialOptions &options, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : CommConnection(blockingTime, debug, noReads, bufferOptions) {
+    openPort(portName, options.baudRate);
+}
+
 SerialConnection::SerialConnection(const SerialConnection &other) : CommConnection(other) {
     if(this == &other) {
         return;
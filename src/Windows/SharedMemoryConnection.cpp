@@ -0,0 +1,46 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "../SharedMemoryConnection.h"
+
+// there is no shared memory transport here yet, so the connection never connects
+
+// protected:
+void SharedMemoryConnection::failedRead() {
+	connected = false;
+}
+
+int SharedMemoryConnection::getData(char *buff, const int &buffSize) {
+	return -1;
+}
+
+void SharedMemoryConnection::exitGracefully() {
+}
+
+bool SharedMemoryConnection::setBlocking(const int &blockingTime) {
+	return true;
+}
+
+// public:
+SharedMemoryConnection::SharedMemoryConnection(const char *name, const bool &create, const size_t &ringSize, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : CommConnection(blockingTime, debug, noReads, bufferOptions) {
+	connected = false;
+	fprintf(stderr, "SharedMemoryConnection is not supported on this os\n");
+}
+
+SharedMemoryConnection::SharedMemoryConnection(const SharedMemoryConnection &other) : CommConnection(other) {
+}
+
+SharedMemoryConnection &SharedMemoryConnection::operator=(const SharedMemoryConnection &other) {
+    CommConnection::operator=(other);
+    return *this;
+}
+
+bool SharedMemoryConnection::isPeerAttached() const {
+	return false;
+}
+
+bool SharedMemoryConnection::write(const char *buff, const int &buffSize) {
+	return false;
+}
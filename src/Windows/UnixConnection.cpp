@@ -0,0 +1,42 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "../UnixConnection.h"
+
+// there are no Unix domain sockets here yet, so the connection never connects
+
+// protected:
+void UnixConnection::failedRead() {
+	connected = false;
+}
+
+int UnixConnection::getData(char *buff, const int &buffSize) {
+	return -1;
+}
+
+void UnixConnection::exitGracefully() {
+}
+
+bool UnixConnection::setBlocking(const int &blockingTime) {
+	return true;
+}
+
+// public:
+UnixConnection::UnixConnection(const char *path, const int &socketType, const bool &server, const int &blockingTime, const bool &debug, const bool &noReads, const BufferOptions &bufferOptions) : CommConnection(blockingTime, debug, noReads, bufferOptions) {
+	connected = false;
+	fprintf(stderr, "UnixConnection is not supported on this os\n");
+}
+
+UnixConnection::UnixConnection(const UnixConnection &other) : CommConnection(other) {
+}
+
+UnixConnection &UnixConnection::operator=(const UnixConnection &other) {
+    CommConnection::operator=(other);
+    return *this;
+}
+
+bool UnixConnection::write(const char *buff, const int &buffSize) {
+	return false;
+}
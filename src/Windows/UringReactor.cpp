@@ -0,0 +1,50 @@
+/* Copyright 2018 Ryan Cooper (RyanLoringCooper@gmail.com)
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "../UringReactor.h"
+
+// there is no io_uring on windows, so this is only IoReactor, which isn't supported there either
+
+// public:
+UringReactor::UringReactor(const int &threadCount, const bool &debug, const unsigned int &sqPollMillis) : IoReactor(threadCount, debug) {
+}
+
+UringReactor::~UringReactor() {
+}
+
+bool UringReactor::isUsingUring() const {
+	return false;
+}
+
+bool UringReactor::begin() {
+	return IoReactor::begin();
+}
+
+void UringReactor::terminate() {
+	IoReactor::terminate();
+}
+
+bool UringReactor::add(CommConnection *conn) {
+	return IoReactor::add(conn);
+}
+
+void UringReactor::remove(CommConnection *conn) {
+	IoReactor::remove(conn);
+}
+
+void UringReactor::resume(CommConnection *conn) {
+	IoReactor::resume(conn);
+}
+
+size_t UringReactor::size() {
+	return IoReactor::size();
+}
+
+bool UringReactor::write(CommConnection *conn, const char *buff, const size_t &length, const UringWriteCallback &callback, const bool &submit) {
+	return conn->write(buff, length);
+}
+
+void UringReactor::submit() {
+}
@@ -0,0 +1,247 @@
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include "../src/NetworkConnection.h"
+#include "../src/CommCoroutine.h"
+#include "TestPattern.h"
+
+#if !defined(__cpp_impl_coroutine)
+#error CommCoroutineTest has to be built as C++20
+#endif
+
+// how many connections one scheduler thread serves at once
+#define SESSIONS 4
+// how many lines each peer sends and waits to have echoed back
+#define LINES 32
+// the limit the long line is read with, and how long that line is
+#define LINE_LIMIT 64
+#define LONG_LINE 100
+// how many bytes a session waits for after the peer has sent one less and the connection ends
+#define TAIL_SIZE 8
+
+const std::string helpText("Usage:\n\tCommCoroutineTest [-h] [-n <bytes>]\n\n\t"
+        "Runs sessions on NetworkConnections over the loopback interface as coroutines, all on one CommScheduler\n\t"
+        "thread. Each co_awaits readExactly for a header and a body the peer sends in bursts, readUntil for lines that\n\t"
+        "it echoes back with write, and readUntil with a limit for a line longer than it. The peer then sends part of\n\t"
+        "a message and the connection is terminated, so the read waiting for the rest has to come back empty.\n\n\t"
+        "-h shows this help text\n\t"
+        "-n <bytes> = how big the body each peer sends is. Defaults to 1048576.\n"
+        );
+
+// what a session found, filled in by its coroutine
+struct Outcome {
+    // whether everything before the end of the connection was read and echoed intact
+    bool ok = false;
+    // whether the read that was waiting when the connection ended came back empty
+    bool ended = false;
+};
+
+// the line number i, without its newline
+std::string lineAt(const int &i) {
+    return "line " + std::to_string(i) + std::string(i, '.');
+}
+
+// sends all of data to fd. Returns false if it can't
+bool sendAll(const int &fd, const std::string &data) {
+    for(size_t sent = 0; sent < data.size();) {
+        ssize_t result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(result <= 0) {
+            perror("send");
+            return false;
+        }
+        sent += result;
+    }
+    return true;
+}
+
+// reads exactly length bytes from fd into data, waiting at most TIMEOUT for each part. Returns false if it can't
+bool receiveAll(const int &fd, const size_t &length, std::string &data) {
+    data.resize(length);
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    for(size_t received = 0; received < length;) {
+        if(poll(&pfd, 1, TIMEOUT) <= 0) {
+            std::cerr << "Timed out after " << received << " of " << length << " echoed bytes.\n";
+            return false;
+        }
+        ssize_t result = recv(fd, &data[received], length - received, 0);
+        if(result <= 0) {
+            perror("recv");
+            return false;
+        }
+        received += result;
+    }
+    return true;
+}
+
+// plays the other end of a session on fd, pausing between parts so the session has to suspend for each of them
+bool playPeer(const int &fd, const size_t &bytes) {
+    uint32_t length = bytes;
+    if(!sendAll(fd, std::string((const char *) &length, sizeof(length)))) {
+        return false;
+    }
+    std::string body(bytes, '\0');
+    fillPattern(&body[0], bytes, 0);
+    for(size_t sent = 0, round = 0; sent < bytes; round++) {
+        size_t count = std::min<size_t>(1 + (round * 1777) % BUFF_SIZE, bytes - sent);
+        if(!sendAll(fd, body.substr(sent, count))) {
+            return false;
+        }
+        sent += count;
+        if(round % 64 == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    std::string echo;
+    for(int i = 0; i < LINES; i++) {
+        std::string line = lineAt(i) + "\n";
+        // gives the session time to wait for the line before it is sent
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if(!sendAll(fd, line) || !receiveAll(fd, line.size(), echo)) {
+            return false;
+        } else if(echo != line) {
+            std::cerr << "Line " << i << " was echoed as " << echo;
+            return false;
+        }
+    }
+    return sendAll(fd, std::string(LONG_LINE, 'x') + "\n") && sendAll(fd, std::string(TAIL_SIZE - 1, 't'));
+}
+
+// reads what playPeer(2) sends through async, echoing each line back, and then waits for more than the peer sends
+CommTask session(AsyncConnection &async, Outcome &outcome) {
+    std::optional<std::string> header = co_await async.readExactly(sizeof(uint32_t));
+    if(!header) {
+        std::cerr << "The header never came.\n";
+        co_return;
+    }
+    uint32_t length;
+    memcpy(&length, header->data(), sizeof(length));
+    std::optional<std::string> body = co_await async.readExactly(length);
+    if(!body || body->size() != length || !matches(body->data(), length, 0)) {
+        std::cerr << "The body of " << length << " bytes didn't come intact.\n";
+        co_return;
+    }
+    for(int i = 0; i < LINES; i++) {
+        std::optional<std::string> line = co_await async.readUntil('\n');
+        if(!line || *line != lineAt(i)) {
+            std::cerr << "Line " << i << " was read as " << (line ? *line : "nothing") << ".\n";
+            co_return;
+        }
+        if(!co_await async.write(*line + "\n")) {
+            perror("AsyncConnection::write");
+            co_return;
+        }
+    }
+    // the line is longer than the limit, so it comes in two parts
+    std::optional<std::string> first = co_await async.readUntil('\n', LINE_LIMIT);
+    std::optional<std::string> rest = co_await async.readUntil('\n', LINE_LIMIT);
+    if(!first || !rest || *first != std::string(LINE_LIMIT, 'x') || *rest != std::string(LONG_LINE - LINE_LIMIT, 'x')) {
+        std::cerr << "The long line wasn't split at the limit.\n";
+        co_return;
+    }
+    outcome.ok = true;
+    std::optional<std::string> tail = co_await async.readExactly(TAIL_SIZE);
+    outcome.ended = !tail;
+}
+
+// runs SESSIONS sessions on one scheduler thread while their peers play them, then ends the connections
+bool checkSessions(const size_t &bytes) {
+    int port;
+    int listener = listenOnLoopback(port);
+    if(listener < 0) {
+        return false;
+    }
+    CommScheduler scheduler;
+    std::vector<NetworkConnection *> conns;
+    std::vector<AsyncConnection *> asyncs;
+    std::vector<int> fds;
+    Outcome outcomes[SESSIONS];
+    bool ok = true;
+    for(int i = 0; i < SESSIONS && ok; i++) {
+        conns.push_back(new NetworkConnection(port, SOCK_STREAM, "127.0.0.1"));
+        fds.push_back(acceptClient(listener));
+        if(fds.back() < 0 || !conns.back()->begin()) {
+            std::cerr << "Could not set up connection " << i << ".\n";
+            ok = false;
+        } else {
+            asyncs.push_back(new AsyncConnection(*conns.back(), scheduler));
+            scheduler.spawn(session(*asyncs.back(), outcomes[i]));
+        }
+    }
+    close(listener);
+    std::atomic<int> played(0);
+    std::vector<std::thread> peers;
+    for(size_t i = 0; i < asyncs.size(); i++) {
+        peers.push_back(std::thread([&, i]() {
+            if(playPeer(fds[i], bytes)) {
+                played++;
+            }
+        }));
+    }
+    std::thread closer([&]() {
+        for(size_t i = 0; i < peers.size(); i++) {
+            peers[i].join();
+        }
+        // lets the sessions get to the read that will never be satisfied
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        for(size_t i = 0; i < conns.size(); i++) {
+            conns[i]->terminate();
+        }
+        for(int waited = 0; scheduler.size() > 0 && waited < TIMEOUT; waited++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if(scheduler.size() > 0) {
+            std::cerr << scheduler.size() << " sessions were still waiting after their connections ended.\n";
+            scheduler.stop();
+        }
+    });
+    size_t resumed = scheduler.run();
+    closer.join();
+    ok = ok && scheduler.size() == 0 && played.load() == SESSIONS;
+    for(int i = 0; i < SESSIONS; i++) {
+        if(!outcomes[i].ok || !outcomes[i].ended) {
+            std::cerr << "Session " << i << (outcomes[i].ok ? " wasn't told its connection ended.\n" : " failed.\n");
+            ok = false;
+        }
+    }
+    printf("%zu resumes\n", resumed);
+    // a session that is still suspended would be resumed on a connection that is gone
+    if(scheduler.size() == 0) {
+        for(size_t i = 0; i < asyncs.size(); i++) {
+            delete asyncs[i];
+        }
+        for(size_t i = 0; i < conns.size(); i++) {
+            delete conns[i];
+        }
+    }
+    for(size_t i = 0; i < fds.size(); i++) {
+        if(fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    size_t bytes = 1024 * 1024;
+    SizeOption options[] = {
+        {"-n", "bytes", &bytes, 1}
+    };
+    int result = parseOptions(argc, argv, helpText, options, 1);
+    if(result >= 0) {
+        return result;
+    } else if(bytes > _BUFFER_SIZE) {
+        std::cerr << "Improper usage. bytes must be at most " << _BUFFER_SIZE << ", since the body is read in one piece.\n";
+        return 1;
+    }
+    int failures = 0;
+    printf("sessions\n");
+    if(!checkSessions(bytes)) {
+        std::cerr << "The sessions failed.\n";
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
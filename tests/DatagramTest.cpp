@@ -0,0 +1,146 @@
+#include <vector>
+#include <cstdint>
+#include "../src/NetworkConnection.h"
+#include "TestPattern.h"
+
+// how many datagrams are sent before waiting for them to be read, so none are dropped for want of room
+#define DATAGRAM_BURST 32
+// the most bytes one datagram holds
+#define MESSAGE_SIZE 1400
+// how many datagrams in a row share a length when they are sent together, so they can go out as segments of one send
+#define RUN_LENGTH 8
+
+const std::string helpText("Usage:\n\tDatagramTest [-h] [-n <bytes>]\n\n\t"
+        "Sends datagrams of many lengths over the loopback interface to a NetworkConnection in datagram mode and\n\t"
+        "reads them back one at a time and in batches. They are sent one write at a time, and then with writeDatagrams\n\t"
+        "in runs of the same length so they go out segmented. Each starts with its sequence number and goes on with a\n\t"
+        "pattern from there, so one that is cut short, merged with another or delivered out of order is caught.\n\n\t"
+        "-h shows this help text\n\t"
+        "-n <bytes> = roughly how many bytes are sent. Defaults to 4194304.\n"
+        );
+
+// the length of datagram number, which is at least big enough for the number. If runs is set, RUN_LENGTH datagrams in
+// a row have the same length
+size_t datagramLength(const uint32_t &number, const bool &runs) {
+    return sizeof(number) + (runs ? (number / RUN_LENGTH) * 389 : number * 97) % (MESSAGE_SIZE - sizeof(number));
+}
+
+// fills buff with datagram number and returns its length
+size_t fillDatagram(char *buff, const uint32_t &number, const size_t &length) {
+    memcpy(buff, &number, sizeof(number));
+    fillPattern(buff + sizeof(number), length - sizeof(number), number);
+    return length;
+}
+
+// returns false and says why if the length bytes in buff, from source, aren't datagram number
+bool isDatagram(const char *buff, const int &length, const SocketAddress &source, const uint32_t &number, const bool &runs) {
+    uint32_t got = 0;
+    if(length >= (int) sizeof(got)) {
+        memcpy(&got, buff, sizeof(got));
+    }
+    if(length != (int) datagramLength(number, runs) || got != number) {
+        std::cerr << "Got datagram " << got << " of " << length << " bytes instead of " << number << " of " << datagramLength(number, runs) << ".\n";
+        return false;
+    } else if(source.sa.sa_family != AF_INET && source.sa.sa_family != AF_INET6) {
+        std::cerr << "Datagram " << number << " doesn't say who sent it.\n";
+        return false;
+    }
+    return matches(buff + sizeof(got), length - sizeof(got), number);
+}
+
+// sends the datagrams one write at a time, or with writeDatagrams if batched is set, and reads every other burst with
+// readDatagrams and the rest with readDatagram. Every other batch sends to an address of its own instead of the default
+bool checkDatagrams(const size_t &bytes, const bool &batched) {
+    int port = freePort(SOCK_DGRAM);
+    NetworkConnection server(port, SOCK_DGRAM);
+    NetworkConnection client(port, SOCK_DGRAM, "127.0.0.1");
+    if(port == 0 || !server.isConnected() || !client.isConnected() || !server.useDatagrams(true, DATAGRAM_BURST, MESSAGE_SIZE) || !server.begin()) {
+        std::cerr << "Could not set up the UDP connections.\n";
+        return false;
+    }
+    SocketAddress destination;
+    memset(&destination, 0, sizeof(destination));
+    destination.v4.sin_family = AF_INET;
+    destination.v4.sin_port = htons(port);
+    destination.v4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::vector<char> data(DATAGRAM_BURST * MESSAGE_SIZE);
+    bool ok = true;
+    uint32_t sequence = 0;
+    for(size_t sent = 0; sent < bytes && ok; sequence += DATAGRAM_BURST) {
+        char buff[MESSAGE_SIZE];
+        bool odd = (sequence / DATAGRAM_BURST) % 2 == 1;
+        if(batched) {
+            std::vector<OutgoingDatagram> datagrams(DATAGRAM_BURST);
+            for(int i = 0; i < DATAGRAM_BURST; i++) {
+                datagrams[i].data = &data[i * MESSAGE_SIZE];
+                datagrams[i].length = fillDatagram(&data[i * MESSAGE_SIZE], sequence + i, datagramLength(sequence + i, true));
+                datagrams[i].destination = odd ? &destination : NULL;
+                sent += datagrams[i].length;
+            }
+            for(int done = 0; done < DATAGRAM_BURST && ok;) {
+                std::vector<OutgoingDatagram> rest(datagrams.begin() + done, datagrams.end());
+                int result = client.writeDatagrams(rest);
+                if(result < 0) {
+                    perror("NetworkConnection::writeDatagrams");
+                    ok = false;
+                }
+                done += result;
+            }
+        }
+        for(int i = 0; i < DATAGRAM_BURST && ok && !batched; i++) {
+            size_t length = fillDatagram(buff, sequence + i, datagramLength(sequence + i, false));
+            if(!client.write(buff, length)) {
+                perror("NetworkConnection::write");
+                ok = false;
+            }
+            sent += length;
+        }
+        for(int i = 0; i < DATAGRAM_BURST && ok;) {
+            if(server.waitForData(TIMEOUT) == 0) {
+                std::cerr << "Timed out waiting for datagram " << sequence + i << ".\n";
+                ok = false;
+            } else if(odd) {
+                Datagram datagrams[DATAGRAM_BURST];
+                for(int j = 0; j < DATAGRAM_BURST; j++) {
+                    datagrams[j].data = &data[j * MESSAGE_SIZE];
+                    datagrams[j].capacity = MESSAGE_SIZE;
+                }
+                int count = server.readDatagrams(datagrams, DATAGRAM_BURST - i);
+                for(int j = 0; j < count && ok; j++, i++) {
+                    ok = isDatagram(datagrams[j].data, datagrams[j].length, datagrams[j].source, sequence + i, batched);
+                }
+            } else {
+                SocketAddress source;
+                int length = server.readDatagram(buff, MESSAGE_SIZE, &source);
+                ok = isDatagram(buff, length, source, sequence + i, batched);
+                i++;
+            }
+        }
+    }
+    client.terminate();
+    server.terminate();
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    size_t bytes = 4 * 1024 * 1024;
+    SizeOption options[] = {
+        {"-n", "bytes", &bytes, 1}
+    };
+    int result = parseOptions(argc, argv, helpText, options, 1);
+    if(result >= 0) {
+        return result;
+    }
+    int failures = 0;
+    printf("datagrams\n");
+    if(!checkDatagrams(bytes, false)) {
+        std::cerr << "Datagrams failed.\n";
+        failures++;
+    }
+    printf("batched datagrams\n");
+    if(!checkDatagrams(bytes, true)) {
+        std::cerr << "Batched datagrams failed.\n";
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
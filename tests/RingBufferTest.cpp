@@ -0,0 +1,295 @@
+#include <thread>
+#include <atomic>
+#include "../src/RingBuffer.h"
+#include "TestPattern.h"
+
+// how many times around the buffer the single threaded checks go
+#define LAPS 16
+// what the resize check lets the buffer grow to
+#define MAX_SIZE 262144
+
+const std::string helpText("Usage:\n\tRingBufferTest [-h] [-n <bytes>]\n\n\t"
+        "Checks RingBuffer with normal and mirrored storage: writing in place and peeking across the end of the\n\t"
+        "storage, growing and shrinking while a consumer thread reads, and a producer that drops the oldest data\n\t"
+        "while the consumer reads it with read, readSome and copyAt/consumeAt. Every byte is checked against a pattern.\n\n\t"
+        "-h shows this help text\n\t"
+        "-n <bytes> = how many bytes each threaded check streams through the buffer. Defaults to 16777216.\n"
+        );
+
+// returns false if the length bytes in buff aren't a run of the pattern, wherever it starts
+bool isRun(const char *buff, const size_t &length) {
+    for(size_t i = 1; i < length; i++) {
+        if((unsigned char) buff[i] != ((unsigned char) buff[i - 1] + 1) % 251) {
+            std::cerr << "A read of " << length << " bytes skips at byte " << i << ".\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// writes up to length bytes of the pattern in place, as a reading thread would, and returns how many were written
+size_t writePattern(RingBuffer &buffer, const size_t &written, const size_t &length, int &regionCount) {
+    BufferRegion regions[2];
+    regionCount = buffer.writeRegions(regions);
+    size_t count = 0;
+    for(int i = 0; i < regionCount && count < length; i++) {
+        for(size_t j = 0; j < regions[i].length && count < length; j++, count++) {
+            regions[i].data[j] = patternAt(written + count);
+        }
+    }
+    buffer.commitWrite(count);
+    return count;
+}
+
+// writes and peeks at odd sizes so both keep crossing the end of the storage, and checks what is split and what isn't
+bool checkWrapAround(const bool &mirrored) {
+    RingBuffer buffer(BufferOptions(64, 0, 0, mirrored));
+    if(!buffer.allocate()) {
+        std::cerr << "Could not allocate the buffer.\n";
+        return false;
+    }
+    size_t capacity = buffer.size();
+    if(buffer.isMirrored() != mirrored) {
+        std::cerr << "The buffer is " << (mirrored ? "not " : "") << "mirrored.\n";
+        return false;
+    }
+    if(mirrored) {
+        BufferRegion storage = buffer.storageRegion();
+        if(storage.length != 2 * capacity) {
+            std::cerr << "The mirrored storage is " << storage.length << " bytes instead of " << 2 * capacity << ".\n";
+            return false;
+        }
+        storage.data[capacity - 1] = 'a';
+        storage.data[capacity] = 'b';
+        if(storage.data[2 * capacity - 1] != 'a' || storage.data[0] != 'b') {
+            std::cerr << "The second view of the storage doesn't show the first.\n";
+            return false;
+        }
+    }
+    size_t written = 0, consumed = 0;
+    bool splitRegions = false, splitSpans = false;
+    char buff[BUFF_SIZE];
+    for(size_t round = 0; written < LAPS * capacity; round++) {
+        size_t unread = written - consumed;
+        BufferRegion regions[2];
+        int regionCount = buffer.writeRegions(regions);
+        size_t space = 0;
+        for(int i = 0; i < regionCount; i++) {
+            space += regions[i].length;
+        }
+        if(space != capacity - unread) {
+            std::cerr << "writeRegions offered " << space << " bytes with " << capacity - unread << " free.\n";
+            return false;
+        }
+        splitRegions |= regionCount == 2;
+        // an odd share of the free space, so the head lands all over the storage
+        size_t count = writePattern(buffer, written, 1 + (round * 37) % (space == 0 ? 1 : space), regionCount);
+        written += count;
+        BufferSpan spans[2];
+        int spanCount = buffer.peek(spans);
+        size_t seen = 0;
+        for(int i = 0; i < spanCount; i++) {
+            if(!matches(spans[i].data, spans[i].length, consumed + seen)) {
+                return false;
+            }
+            seen += spans[i].length;
+        }
+        if(seen != written - consumed) {
+            std::cerr << "peek showed " << seen << " bytes with " << written - consumed << " unread.\n";
+            return false;
+        }
+        splitSpans |= spanCount == 2;
+        if(mirrored && (regionCount > 1 || spanCount > 1)) {
+            std::cerr << "Mirrored storage split a region at " << written << " bytes.\n";
+            return false;
+        }
+        if((unsigned char) buffer.at(seen - 1) != patternAt(written - 1)) {
+            std::cerr << "at(" << seen - 1 << ") is not the last byte written.\n";
+            return false;
+        }
+        // leaves some unread, so what is written next wraps around behind it
+        size_t length = 1 + (round * 53) % seen;
+        if(!buffer.read(buff, length) || !matches(buff, length, consumed)) {
+            return false;
+        }
+        consumed += length;
+    }
+    if(!mirrored && (!splitRegions || !splitSpans)) {
+        std::cerr << "The data never wrapped around the end of the storage.\n";
+        return false;
+    }
+    return true;
+}
+
+// streams bytes through a buffer that is filled until it grows to MAX_SIZE and then kept nearly empty so it shrinks
+// while a consumer thread reads and checks every byte
+bool checkResize(const bool &mirrored, const size_t &bytes) {
+    RingBuffer buffer(BufferOptions(BUFF_SIZE, BUFF_SIZE, MAX_SIZE, mirrored));
+    if(!buffer.allocate()) {
+        std::cerr << "Could not allocate the buffer.\n";
+        return false;
+    }
+    size_t smallest = buffer.size();
+    std::atomic<bool> filled(false), failed(false);
+    std::thread consumer([&]() {
+        while(!filled.load()) {
+            std::this_thread::yield();
+        }
+        char buff[BUFF_SIZE];
+        for(size_t consumed = 0, round = 0; consumed < bytes && !failed.load(); round++) {
+            size_t count = buffer.readSome(buff, 1 + (round * 389) % BUFF_SIZE);
+            if(count == 0) {
+                std::this_thread::yield();
+            } else if(!matches(buff, count, consumed)) {
+                failed.store(true);
+            }
+            consumed += count;
+        }
+    });
+    size_t written = 0, largest = 0;
+    for(size_t round = 0; written < bytes && !failed.load(); round++) {
+        size_t length = 1 + (round * 911) % 3000;
+        if(filled.load()) {
+            // lets the consumer catch up, so the buffer is empty each time it is written to
+            while(buffer.available() > 0 && !failed.load()) {
+                std::this_thread::yield();
+            }
+        }
+        int regionCount;
+        written += writePattern(buffer, written, length, regionCount);
+        size_t size = buffer.size();
+        if(size > largest) {
+            largest = size;
+        }
+        if(filled.load() && size < smallest) {
+            smallest = size;
+        }
+        if(regionCount == 0 && !filled.load()) {
+            filled.store(true);
+            smallest = size;
+        }
+    }
+    filled.store(true);
+    consumer.join();
+    if(failed.load()) {
+        return false;
+    } else if(largest != MAX_SIZE || smallest != BUFF_SIZE) {
+        std::cerr << "The buffer went from " << smallest << " to " << largest << " bytes instead of between " << BUFF_SIZE << " and " << MAX_SIZE << ".\n";
+        return false;
+    }
+    return true;
+}
+
+// streams bytes through a buffer whose producer drops the oldest data to make room, while the consumer takes it in
+// turns with read, readSome and copyAt/consumeAt. Whatever the consumer gets must be intact, and what it got and what
+// was dropped must add up to what was written
+bool checkDrops(const bool &mirrored, const size_t &bytes) {
+    RingBuffer buffer(BufferOptions(BUFF_SIZE, 0, 0, mirrored));
+    buffer.allowProducerDrops(true);
+    if(!buffer.allocate()) {
+        std::cerr << "Could not allocate the buffer.\n";
+        return false;
+    }
+    std::atomic<bool> done(false), failed(false);
+    size_t received = 0, reads[3] = {0, 0, 0};
+    std::thread consumer([&]() {
+        char buff[BUFF_SIZE];
+        for(size_t round = 0; !failed.load(); round++) {
+            bool finished = done.load();
+            size_t length = 1 + (round * 211) % 1500;
+            size_t count = 0;
+            if(round % 3 == 0) {
+                if(buffer.read(buff, length)) {
+                    count = length;
+                }
+            } else if(round % 3 == 1) {
+                count = buffer.readSome(buff, length);
+            } else {
+                size_t start = buffer.position();
+                size_t available = buffer.available();
+                if(length > available) {
+                    length = available;
+                }
+                if(length > 0 && buffer.copyAt(start, buff, length) && buffer.consumeAt(start, length)) {
+                    if(!matches(buff, length, start)) {
+                        failed.store(true);
+                    }
+                    count = length;
+                }
+            }
+            if(count > 0 && !isRun(buff, count)) {
+                failed.store(true);
+            }
+            received += count;
+            reads[round % 3] += count > 0;
+            if(count == 0) {
+                if(finished && buffer.available() == 0) {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    });
+    size_t written = 0, dropped = 0;
+    char buff[BUFF_SIZE];
+    for(size_t round = 0; written < bytes && !failed.load(); round++) {
+        size_t length = 1 + (round * 757) % 1500;
+        if(length > bytes - written) {
+            length = bytes - written;
+        }
+        if(buffer.freeSpace() < length) {
+            dropped += buffer.dropTo(buffer.writePosition() + length - buffer.size());
+        }
+        fillPattern(buff, length, written);
+        // the consumer only ever frees more space, so what was made room for is still there
+        if(buffer.write(buff, length) != length) {
+            std::cerr << "Only part of " << length << " bytes fit after dropping the oldest.\n";
+            failed.store(true);
+        }
+        written += length;
+    }
+    done.store(true);
+    consumer.join();
+    if(failed.load()) {
+        return false;
+    } else if(received + dropped != written) {
+        std::cerr << received << " bytes were read and " << dropped << " dropped out of " << written << ".\n";
+        return false;
+    } else if(dropped == 0 || reads[0] == 0 || reads[1] == 0 || reads[2] == 0) {
+        std::cerr << "The producer never dropped data, or a way of reading never got any, so nothing raced.\n";
+        return false;
+    }
+    printf("%zu bytes read, %zu dropped, %zu/%zu/%zu reads through read/readSome/copyAt\n", received, dropped, reads[0], reads[1], reads[2]);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    size_t bytes = 16 * 1024 * 1024;
+    SizeOption options[] = {
+        {"-n", "bytes", &bytes, 1}
+    };
+    int result = parseOptions(argc, argv, helpText, options, 1);
+    if(result >= 0) {
+        return result;
+    }
+    int failures = 0;
+    for(int mirrored = 0; mirrored < 2; mirrored++) {
+        const char *storage = mirrored ? "mirrored" : "normal";
+        printf("%s wrap around\n", storage);
+        if(!checkWrapAround(mirrored)) {
+            std::cerr << "Wrap around with " << storage << " storage failed.\n";
+            failures++;
+        }
+        printf("%s grow and shrink\n", storage);
+        if(!checkResize(mirrored, bytes)) {
+            std::cerr << "Growing and shrinking " << storage << " storage failed.\n";
+            failures++;
+        }
+        printf("%s drops\n", storage);
+        if(!checkDrops(mirrored, bytes)) {
+            std::cerr << "Dropping from " << storage << " storage failed.\n";
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
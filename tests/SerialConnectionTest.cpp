@@ -0,0 +1,363 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include "../src/SerialConnection.h"
+#include "../src/SerialGroup.h"
+#include "TestPattern.h"
+
+// the size of the frames latency is measured with
+#define FRAME_SIZE 16
+// how long the CPU time of an idle connection is measured for, in milliseconds
+#define IDLE_TIME 500
+
+const std::string helpText("Usage:\n\tSerialConnectionTest [-h] [-b <baud_rate>] [-p <parity>] [-n <bytes>] [-s <samples>] [-f]\n\n\t"
+        "Opens pseudo terminals as stand ins for serial devices and reads from them with SerialConnection in each of the\n\t"
+        "blockingTime modes, and with a SerialGroup, reporting bytes/s, CPU usage and how long a frame takes to be read.\n\t"
+        "A pseudo terminal doesn't limit itself to the baud rate, so the data is sent at the line rate unless -f is given,\n\t"
+        "and the latency is only what the software adds.\n\n\t"
+        "-h shows this help text\n\t"
+        "-b <baud_rate> = the baud rate the port is set to and the data is sent at. Defaults to 115200.\n\t"
+        "-p <parity> = none, even or odd. Defaults to none. Not every kernel lets a pseudo terminal take parity.\n\t"
+        "-n <bytes> = how many bytes are sent to each mode. Defaults to a second of data at the line rate.\n\t"
+        "-s <samples> = how many frames latency is measured with. Defaults to 200.\n\t"
+        "-f sends the data as fast as the pseudo terminal takes it instead of at the line rate.\n"
+        );
+
+// how a connection is read from
+struct Mode {
+    const char *name;
+    int blockingTime;
+    // read by a SerialGroup instead of a thread of its own
+    bool group;
+};
+
+struct Result {
+    size_t bytes, reads;
+    double seconds, cpuSeconds, idleCpuSeconds;
+    // how long each frame took to be read after it was sent, in microseconds
+    std::vector<double> latencies;
+};
+
+// returns the CPU time used by every thread of the process, in seconds
+double cpuTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// opens a pseudo terminal to stand in for a serial device. The connection opens the slave at name and the
+// returned master plays the device on the other end of the line. Returns -1 if one can't be made
+int openPty(std::string &name) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0) {
+        perror("posix_openpt");
+        return -1;
+    }
+    if(grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("grantpt");
+        close(master);
+        return -1;
+    }
+    name = ptsname(master);
+    return master;
+}
+
+// writes all of buff to the master. Returns false if it couldn't
+bool writeAll(const int &master, const char *buff, const size_t &length) {
+    size_t written = 0;
+    while(written < length) {
+        ssize_t result = write(master, buff + written, length - written);
+        if(result < 0) {
+            perror("write to pty");
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+// plays the device, sending bytes bytes of the pattern at bytesPerSecond, or as fast as the pty takes them if that is 0
+void sendPattern(int master, size_t bytes, size_t bytesPerSecond, bool *ok) {
+    char buff[BUFF_SIZE];
+    // a write every millisecond or so at the line rate, like a UART handing over what its FIFO has
+    size_t chunk = bytesPerSecond == 0 ? BUFF_SIZE : std::min<size_t>(std::max<size_t>(bytesPerSecond / 1000, 1), BUFF_SIZE);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(size_t sent = 0; sent < bytes;) {
+        size_t length = std::min(chunk, bytes - sent);
+        fillPattern(buff, length, sent);
+        if(!writeAll(master, buff, length)) {
+            *ok = false;
+            return;
+        }
+        sent += length;
+        if(bytesPerSecond != 0) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds((unsigned long long) sent * 1000000 / bytesPerSecond));
+        }
+    }
+    *ok = true;
+}
+
+// waits for conn to hold at least bytes bytes, through group if it reads conn
+// returns available(), which is 0 if it timed out
+unsigned int waitFor(CommConnection *conn, SerialGroup *group, const unsigned int &bytes) {
+    if(group == NULL) {
+        if(bytes == 1) {
+            return conn->waitForData(TIMEOUT);
+        }
+        return conn->waitForBytes(bytes, TIMEOUT) ? conn->available() : 0;
+    }
+    std::vector<size_t> ready;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TIMEOUT);
+    while(conn->available() < bytes) {
+        int left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if(left <= 0 || group->waitForAny(ready, left) == 0) {
+            return 0;
+        }
+    }
+    return conn->available();
+}
+
+// reads bytes bytes of the pattern from conn while they are sent at bytesPerSecond. Returns false if any were wrong
+bool measureThroughput(CommConnection *conn, SerialGroup *group, const int &master, const size_t &bytes, const size_t &bytesPerSecond, Result &result) {
+    char buff[BUFF_SIZE];
+    bool sent = false;
+    double cpuStart = cpuTime();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::thread sender(sendPattern, master, bytes, bytesPerSecond, &sent);
+    bool ok = true;
+    size_t received = 0;
+    while(received < bytes) {
+        unsigned int avail = waitFor(conn, group, 1);
+        if(avail == 0) {
+            std::cerr << "Timed out after " << received << " of " << bytes << " bytes.\n";
+            ok = false;
+            break;
+        }
+        avail = std::min<size_t>(std::min<size_t>(avail, BUFF_SIZE), bytes - received);
+        conn->read(buff, avail);
+        result.reads++;
+        if(!matches(buff, avail, received)) {
+            ok = false;
+            break;
+        }
+        received += avail;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.cpuSeconds = cpuTime() - cpuStart;
+    result.bytes = received;
+    if(!ok) {
+        // unblocks the sender if it is stuck on a full pty
+        tcflush(master, TCIOFLUSH);
+        conn->clearBuffer();
+    }
+    sender.join();
+    return ok && sent;
+}
+
+// sends samples frames one at a time and times how long each takes to be read. Returns false if any didn't arrive intact
+bool measureLatency(CommConnection *conn, SerialGroup *group, const int &master, const size_t &samples, Result &result) {
+    char frame[FRAME_SIZE], buff[FRAME_SIZE];
+    for(size_t i = 0; i < samples; i++) {
+        fillPattern(frame, FRAME_SIZE, i);
+        // leaves the reader idle when the frame arrives, as it would be between frames on a real line
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if(!writeAll(master, frame, FRAME_SIZE)) {
+            return false;
+        }
+        if(waitFor(conn, group, FRAME_SIZE) < FRAME_SIZE) {
+            std::cerr << "Timed out waiting for frame " << i << ".\n";
+            return false;
+        }
+        result.latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        conn->read(buff, FRAME_SIZE);
+        if(memcmp(frame, buff, FRAME_SIZE) != 0) {
+            std::cerr << "Frame " << i << " was corrupted.\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// writes a frame with conn and checks that the master gets it
+bool checkWrite(CommConnection *conn, const int &master) {
+    const std::string message("Hello from the port\n");
+    if(!conn->write(message)) {
+        perror("SerialConnection::write");
+        return false;
+    }
+    std::string received;
+    char buff[BUFF_SIZE];
+    struct pollfd pfd;
+    pfd.fd = master;
+    pfd.events = POLLIN;
+    while(received.size() < message.size()) {
+        if(poll(&pfd, 1, TIMEOUT) <= 0) {
+            std::cerr << "Timed out waiting for the pty to get what was written.\n";
+            return false;
+        }
+        ssize_t result = read(master, buff, BUFF_SIZE);
+        if(result <= 0) {
+            perror("read from pty");
+            return false;
+        }
+        received.append(buff, result);
+    }
+    if(received != message) {
+        std::cerr << "The pty got " << received << " instead of " << message;
+        return false;
+    }
+    return true;
+}
+
+// runs every measurement on a new pty read as mode says. Returns false if the connection failed or lost data
+bool runMode(const Mode &mode, const SerialOptions &options, const size_t &bytes, const size_t &bytesPerSecond, const size_t &samples, Result &result) {
+    std::string name;
+    int master = openPty(name);
+    if(master < 0) {
+        return false;
+    }
+    SerialGroup *group = NULL;
+    SerialConnection *port = NULL;
+    CommConnection *conn = NULL;
+    bool ok = true;
+    if(mode.group) {
+        group = new SerialGroup();
+        if(group->add(name.c_str(), options) < 0 || !group->begin()) {
+            ok = false;
+        } else {
+            conn = group->port(0);
+        }
+    } else {
+        port = new SerialConnection(name.c_str(), options, mode.blockingTime);
+        ok = port->isConnected() && port->begin();
+        conn = port;
+    }
+    if(!ok) {
+        std::cerr << "Could not open " << name << " as a serial port.\n";
+    } else {
+        double cpuStart = cpuTime();
+        std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_TIME));
+        result.idleCpuSeconds = cpuTime() - cpuStart;
+        ok = checkWrite(conn, master)
+            && measureThroughput(conn, group, master, bytes, bytesPerSecond, result)
+            && measureLatency(conn, group, master, samples, result);
+    }
+    if(group != NULL) {
+        group->terminate();
+        delete group;
+    }
+    if(port != NULL) {
+        port->terminate();
+        delete port;
+    }
+    close(master);
+    return ok;
+}
+
+// returns the latency at fraction of the way through the sorted latencies
+double percentile(const std::vector<double> &latencies, const double &fraction) {
+    if(latencies.empty()) {
+        return 0;
+    }
+    return latencies[std::min<size_t>(latencies.size() * fraction, latencies.size() - 1)];
+}
+
+void report(const Mode &mode, Result &result) {
+    std::sort(result.latencies.begin(), result.latencies.end());
+    printf("%-12s %12.0f %10.1f %7.1f %7.1f %9.1f %9.1f %9.1f %9.1f\n", mode.name,
+        result.seconds > 0 ? result.bytes / result.seconds : 0,
+        result.reads > 0 ? (double) result.bytes / result.reads : 0,
+        result.seconds > 0 ? result.cpuSeconds * 100 / result.seconds : 0,
+        result.idleCpuSeconds * 100000 / IDLE_TIME,
+        percentile(result.latencies, 0), percentile(result.latencies, 0.5),
+        percentile(result.latencies, 0.99), percentile(result.latencies, 1));
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int baudRate = 115200;
+    int parity = 0;
+    size_t bytes = 0, samples = 200;
+    bool flood = false;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-h") == 0) {
+            std::cout << helpText << std::endl;
+            return 0;
+        } else if(strcmp(argv[i], "-f") == 0) {
+            flood = true;
+        } else if(i == argc-1) {
+            std::cerr << "Improper usage. " << argv[i] << " must be followed by a value.\n";
+            std::cout << helpText << std::endl;
+            return 1;
+        } else if(strcmp(argv[i], "-b") == 0) {
+            baudRate = strtoul(argv[++i], NULL, 10);
+            if(baudRate == 0) {
+                std::cerr << "Improper usage. baud_rate must be more than 0.\n";
+                return 1;
+            }
+        } else if(strcmp(argv[i], "-p") == 0) {
+            i++;
+            if(strcmp(argv[i], "none") == 0) {
+                parity = 0;
+            } else if(strcmp(argv[i], "even") == 0) {
+                parity = PARENB;
+            } else if(strcmp(argv[i], "odd") == 0) {
+                parity = PARENB | PARODD;
+            } else {
+                std::cerr << "Improper usage. parity must be none, even or odd.\n";
+                return 1;
+            }
+        } else if(strcmp(argv[i], "-n") == 0) {
+            bytes = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "-s") == 0) {
+            samples = strtoull(argv[++i], NULL, 10);
+        } else {
+            std::cerr << "Improper usage. Unknown option " << argv[i] << ".\n";
+            std::cout << helpText << std::endl;
+            return 1;
+        }
+    }
+    // a start bit, 8 data bits, the parity bit if there is one and a stop bit
+    size_t lineRate = baudRate / (parity == 0 ? 10 : 11);
+    if(lineRate == 0) {
+        lineRate = 1;
+    }
+    if(bytes == 0) {
+        bytes = flood ? 16 * 1024 * 1024 : lineRate;
+    }
+    SerialOptions options(baudRate, parity);
+    Mode modes[] = {
+        {"blocking", -1, false},
+        {"polling", 0, false},
+        {"1ms delay", 1, false},
+        {"10ms delay", 10, false},
+        {"SerialGroup", 0, true}
+    };
+
+    printf("%u baud, parity %s, %zu bytes per mode %s, %zu latency samples of %d bytes\n", baudRate,
+        parity == 0 ? "none" : (parity & PARODD ? "odd" : "even"), bytes,
+        flood ? "as fast as possible" : ("at " + std::to_string(lineRate) + " bytes/s").c_str(), samples, FRAME_SIZE);
+    printf("%-12s %12s %10s %7s %7s %9s %9s %9s %9s\n", "mode", "bytes/s", "bytes/read", "cpu%", "idle%",
+        "min us", "median us", "p99 us", "max us");
+    int failures = 0;
+    for(size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        Result result = Result();
+        if(!runMode(modes[i], options, bytes, flood ? 0 : lineRate, samples, result)) {
+            std::cerr << modes[i].name << " failed.\n";
+            failures++;
+        }
+        report(modes[i], result);
+    }
+    return failures == 0 ? 0 : 1;
+}
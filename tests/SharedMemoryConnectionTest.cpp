@@ -0,0 +1,136 @@
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "../src/SharedMemoryConnection.h"
+#include "TestPattern.h"
+
+// the size of the shared memory rings, small enough that the writer has to wait for room
+#define SHM_RING_SIZE 4096
+// the longest line the readUntil check sends, not counting the newline
+#define LINE_SIZE 200
+
+const std::string helpText("Usage:\n\tSharedMemoryConnectionTest [-h] [-n <bytes>]\n\n\t"
+        "Streams a pattern each way through a shared memory segment with rings small enough that both sides park on\n\t"
+        "their futexes, and checks every byte that comes out. Then sends lines of many lengths and reads them back\n\t"
+        "with readUntil.\n\n\t"
+        "-h shows this help text\n\t"
+        "-n <bytes> = roughly how many bytes are sent each way. Defaults to 4194304.\n"
+        );
+
+// streams the pattern each way through a shared memory segment whose rings are too small to hold it, in bursts with
+// pauses between them, so the reader parks when it runs dry and the writer parks when the ring fills
+bool checkSharedMemory(const size_t &bytes) {
+    std::string name = "/SharedMemoryConnectionTest" + std::to_string(getpid());
+    // a small buffer, so the reader stops taking from the ring while it waits for the data to be read
+    SharedMemoryConnection creator(name.c_str(), true, SHM_RING_SIZE, -1, false, false, BufferOptions(2 * SHM_RING_SIZE));
+    SharedMemoryConnection opener(name.c_str(), false, SHM_RING_SIZE, -1, false, false, BufferOptions(2 * SHM_RING_SIZE));
+    if(!creator.isConnected() || !opener.isConnected() || !creator.begin() || !opener.begin()) {
+        std::cerr << "Could not set up the shared memory connections.\n";
+        return false;
+    }
+    bool ok = true;
+    SharedMemoryConnection *sides[2] = {&creator, &opener};
+    for(int direction = 0; direction < 2 && ok; direction++) {
+        SharedMemoryConnection &writer = *sides[direction], &reader = *sides[1 - direction];
+        std::atomic<bool> sent(true);
+        std::thread writing([&]() {
+            char buff[BUFF_SIZE];
+            for(size_t done = 0, round = 0; done < bytes; round++) {
+                size_t count = 1 + (round * 1777) % BUFF_SIZE;
+                if(count > bytes - done) {
+                    count = bytes - done;
+                }
+                fillPattern(buff, count, done);
+                if(!writer.write(buff, count)) {
+                    perror("SharedMemoryConnection::write");
+                    sent.store(false);
+                    return;
+                }
+                done += count;
+                if(round % 64 == 0) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+        });
+        ok = receivePattern(reader, 0, bytes);
+        writing.join();
+        ok = ok && sent.load();
+    }
+    opener.terminate();
+    creator.terminate();
+    return ok;
+}
+
+// the line number i, without its newline
+std::string lineAt(const size_t &i) {
+    return std::string(i % (LINE_SIZE + 1), 'a' + i % 26);
+}
+
+// sends lines of many lengths, including empty ones, through the segment and reads them with readUntil
+bool checkLines(const size_t &bytes) {
+    std::string name = "/SharedMemoryConnectionTest" + std::to_string(getpid());
+    SharedMemoryConnection creator(name.c_str(), true, SHM_RING_SIZE, -1);
+    SharedMemoryConnection opener(name.c_str(), false, SHM_RING_SIZE, -1);
+    if(!creator.isConnected() || !opener.isConnected() || !creator.begin() || !opener.begin()) {
+        std::cerr << "Could not set up the shared memory connections.\n";
+        return false;
+    }
+    size_t lines = bytes / (LINE_SIZE / 2 + 1) + 1;
+    std::atomic<bool> sent(true);
+    std::thread writing([&]() {
+        for(size_t i = 0; i < lines; i++) {
+            if(!creator.write(lineAt(i) + "\n")) {
+                perror("SharedMemoryConnection::write");
+                sent.store(false);
+                return;
+            }
+        }
+    });
+    bool ok = true;
+    char buff[LINE_SIZE + 1];
+    for(size_t i = 0; i < lines && ok; i++) {
+        if(opener.waitForDelimiter('\n', TIMEOUT) < 0) {
+            std::cerr << "Timed out waiting for line " << i << ".\n";
+            ok = false;
+            break;
+        }
+        int length = opener.readUntil(buff, sizeof(buff), '\n');
+        if(length < 0 || std::string(buff, length) != lineAt(i)) {
+            std::cerr << "Line " << i << " is " << length << " bytes instead of " << lineAt(i).size() << " or is wrong.\n";
+            ok = false;
+        }
+    }
+    if(!ok) {
+        // lets the writer out if it is waiting for room
+        opener.terminate();
+        creator.terminate();
+    }
+    writing.join();
+    opener.terminate();
+    creator.terminate();
+    return ok && sent.load();
+}
+
+int main(int argc, char *argv[]) {
+    size_t bytes = 4 * 1024 * 1024;
+    SizeOption options[] = {
+        {"-n", "bytes", &bytes, 1}
+    };
+    int result = parseOptions(argc, argv, helpText, options, 1);
+    if(result >= 0) {
+        return result;
+    }
+    int failures = 0;
+    printf("streams\n");
+    if(!checkSharedMemory(bytes)) {
+        std::cerr << "Streaming failed.\n";
+        failures++;
+    }
+    printf("lines\n");
+    if(!checkLines(bytes)) {
+        std::cerr << "Reading lines failed.\n";
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
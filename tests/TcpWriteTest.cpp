@@ -0,0 +1,226 @@
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "../src/NetworkConnection.h"
+#include "TestPattern.h"
+
+// how many bytes the write queue holds, small enough that writes wait for room
+#define QUEUE_SIZE 16384
+// how big each buffer sent with MSG_ZEROCOPY is
+#define ZERO_COPY_SIZE 65536
+// how long the mode switching check waits between changes, in microseconds
+#define SWITCH_INTERVAL 20
+
+const std::string helpText("Usage:\n\tTcpWriteTest [-h] [-n <bytes>]\n\n\t"
+        "Writes a pattern of odd sized pieces to a NetworkConnection over the loopback interface while the peer reads\n\t"
+        "and checks every byte: through the queued and flushed write modes with a queue small enough that writes wait\n\t"
+        "for room, while another thread keeps switching between the write modes, and with MSG_ZEROCOPY, checking\n\t"
+        "that each buffer is reported done once and in order.\n\n\t"
+        "-h shows this help text\n\t"
+        "-n <bytes> = how many bytes each check writes. Defaults to 4194304.\n"
+        );
+
+// connects a NetworkConnection to a socket listening on the loopback interface and sets fd to the peer's end
+// returns NULL if it can't
+NetworkConnection *connectPeer(int &fd) {
+    int port;
+    int listener = listenOnLoopback(port);
+    if(listener < 0) {
+        return NULL;
+    }
+    NetworkConnection *conn = new NetworkConnection(port, SOCK_STREAM, "127.0.0.1");
+    fd = acceptClient(listener);
+    close(listener);
+    if(fd < 0 || !conn->begin()) {
+        std::cerr << "Could not set up the TCP connection.\n";
+        if(fd >= 0) {
+            close(fd);
+        }
+        delete conn;
+        return NULL;
+    }
+    return conn;
+}
+
+// writes the pattern from index to index+length to conn in pieces of many sizes
+bool writePattern(NetworkConnection &conn, const size_t &index, const size_t &length) {
+    char buff[BUFF_SIZE];
+    for(size_t sent = 0, round = 0; sent < length; round++) {
+        size_t count = 1 + (round * 1777) % BUFF_SIZE;
+        if(count > length - sent) {
+            count = length - sent;
+        }
+        fillPattern(buff, count, index + sent);
+        if(!conn.write(buff, count)) {
+            perror("NetworkConnection::write");
+            return false;
+        }
+        sent += count;
+    }
+    return true;
+}
+
+// writes the pattern through the queued and then the flushed write mode, flushing after each
+bool checkWriteModes(const size_t &bytes) {
+    int fd;
+    NetworkConnection *conn = connectPeer(fd);
+    if(conn == NULL) {
+        return false;
+    }
+    std::atomic<bool> drained(false);
+    std::thread peer([&]() {
+        drained.store(drainPattern(fd, 0, 2 * bytes));
+    });
+    bool ok = true;
+    WriteMode modes[] = {WRITE_QUEUED, WRITE_FLUSHED};
+    for(int mode = 0; mode < 2 && ok; mode++) {
+        if(!conn->setWriteMode(modes[mode], QUEUE_SIZE)) {
+            std::cerr << "Could not change the write mode.\n";
+            ok = false;
+        } else if(!writePattern(*conn, mode * bytes, bytes)) {
+            ok = false;
+        } else if(!conn->flush(TIMEOUT)) {
+            std::cerr << "flush didn't see everything sent.\n";
+            ok = false;
+        }
+    }
+    if(!ok) {
+        // lets the peer give up at once instead of waiting for the rest
+        shutdown(fd, SHUT_RDWR);
+    }
+    peer.join();
+    conn->terminate();
+    delete conn;
+    close(fd);
+    return ok && drained.load();
+}
+
+// writes the pattern while another thread keeps switching the write mode, so writes race with the queue being
+// drained and replaced. Nothing may be lost, repeated or sent out of order
+bool checkModeSwitch(const size_t &bytes) {
+    int fd;
+    NetworkConnection *conn = connectPeer(fd);
+    if(conn == NULL) {
+        return false;
+    }
+    std::atomic<bool> drained(false), done(false);
+    std::thread peer([&]() {
+        drained.store(drainPattern(fd, 0, bytes));
+    });
+    std::atomic<int> switches(0);
+    std::thread switcher([&]() {
+        WriteMode modes[] = {WRITE_QUEUED, WRITE_DIRECT, WRITE_FLUSHED, WRITE_QUEUED};
+        for(int i = 0; !done.load(); i++) {
+            if(conn->setWriteMode(modes[i % 4], QUEUE_SIZE)) {
+                switches++;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(SWITCH_INTERVAL));
+        }
+    });
+    bool ok = writePattern(*conn, 0, bytes);
+    done.store(true);
+    switcher.join();
+    if(ok && !conn->flush(TIMEOUT)) {
+        std::cerr << "flush didn't see everything sent.\n";
+        ok = false;
+    }
+    if(!ok) {
+        shutdown(fd, SHUT_RDWR);
+    }
+    peer.join();
+    printf("%d switches\n", switches.load());
+    conn->terminate();
+    delete conn;
+    close(fd);
+    return ok && drained.load();
+}
+
+// writes the pattern with MSG_ZEROCOPY in buffers of ZERO_COPY_SIZE, and checks that the kernel says it is done with
+// each of them once and in the order they were sent
+bool checkZeroCopy(const size_t &bytes) {
+    // told about each buffer from the reading thread, so they outlive conn
+    std::atomic<unsigned long long> reported(0);
+    std::atomic<bool> misreported(false);
+    int fd;
+    NetworkConnection *conn = connectPeer(fd);
+    if(conn == NULL) {
+        return false;
+    }
+    bool zeroCopy = conn->useZeroCopy(true, [&](const unsigned long long &id, const bool &) {
+        if(id != reported++) {
+            misreported.store(true);
+        }
+    });
+    if(!zeroCopy) {
+        printf("MSG_ZEROCOPY isn't available\n");
+        conn->terminate();
+        delete conn;
+        close(fd);
+        return true;
+    }
+    size_t buffers = (bytes + ZERO_COPY_SIZE - 1) / ZERO_COPY_SIZE;
+    std::vector<char> data(buffers * ZERO_COPY_SIZE);
+    fillPattern(&data[0], data.size(), 0);
+    std::atomic<bool> drained(false);
+    std::thread peer([&]() {
+        drained.store(drainPattern(fd, 0, data.size()));
+    });
+    bool ok = true;
+    for(size_t i = 0; i < buffers && ok; i++) {
+        if(conn->writeZeroCopy(&data[i * ZERO_COPY_SIZE], ZERO_COPY_SIZE) != (long long) i) {
+            perror("NetworkConnection::writeZeroCopy");
+            ok = false;
+        }
+    }
+    if(!ok) {
+        shutdown(fd, SHUT_RDWR);
+    }
+    peer.join();
+    ok = ok && drained.load();
+    if(ok) {
+        // the peer has read everything, so the kernel is done with the buffers or is about to say so
+        for(int waited = 0; conn->zeroCopyCompleted() < buffers && waited < TIMEOUT; waited++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if(conn->zeroCopyCompleted() != buffers) {
+            std::cerr << "Only " << conn->zeroCopyCompleted() << " of " << buffers << " buffers were completed.\n";
+            ok = false;
+        } else if(misreported.load() || reported.load() != buffers) {
+            std::cerr << reported.load() << " buffers were reported out of order or more than once.\n";
+            ok = false;
+        }
+    }
+    conn->terminate();
+    delete conn;
+    close(fd);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    size_t bytes = 4 * 1024 * 1024;
+    SizeOption options[] = {
+        {"-n", "bytes", &bytes, 1}
+    };
+    int result = parseOptions(argc, argv, helpText, options, 1);
+    if(result >= 0) {
+        return result;
+    }
+    int failures = 0;
+    printf("write modes\n");
+    if(!checkWriteModes(bytes)) {
+        std::cerr << "The write modes failed.\n";
+        failures++;
+    }
+    printf("switching write modes\n");
+    if(!checkModeSwitch(bytes)) {
+        std::cerr << "Switching write modes failed.\n";
+        failures++;
+    }
+    printf("zero copy\n");
+    if(!checkZeroCopy(bytes)) {
+        std::cerr << "Zero copy failed.\n";
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
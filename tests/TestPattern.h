@@ -0,0 +1,182 @@
+#pragma once
+#ifndef TESTPATTERN_H
+#define TESTPATTERN_H
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "../src/CommConnection.h"
+
+// what the tests read and write in at a time
+#define BUFF_SIZE 4096
+// how long to wait for data before a check is failed, in milliseconds
+#define TIMEOUT 5000
+
+// a -<flag> <value> option of a test, which has to be at least min
+struct SizeOption {
+    const char *flag;
+    // what the help text calls the value
+    const char *name;
+    size_t *value;
+    size_t min;
+};
+
+// parses the options of a test that only takes -h and sizes. Returns -1 if the test should run, or what main returns
+inline int parseOptions(int argc, char *argv[], const std::string &helpText, const SizeOption *options, const size_t &count) {
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-h") == 0) {
+            std::cout << helpText << std::endl;
+            return 0;
+        } else if(i == argc-1) {
+            std::cerr << "Improper usage. " << argv[i] << " must be followed by a value.\n";
+            std::cout << helpText << std::endl;
+            return 1;
+        }
+        size_t option = 0;
+        while(option < count && strcmp(argv[i], options[option].flag) != 0) {
+            option++;
+        }
+        if(option == count) {
+            std::cerr << "Improper usage. Unknown option " << argv[i] << ".\n";
+            std::cout << helpText << std::endl;
+            return 1;
+        }
+        *options[option].value = strtoull(argv[++i], NULL, 10);
+        if(*options[option].value < options[option].min) {
+            std::cerr << "Improper usage. " << options[option].name << " must be at least " << options[option].min << ".\n";
+            return 1;
+        }
+    }
+    return -1;
+}
+
+// the byte sent at index. 251 is prime so the pattern doesn't line up with the size of any read
+inline unsigned char patternAt(const size_t &index) {
+    return index % 251;
+}
+
+// fills buff with the pattern from index to index+length
+inline void fillPattern(char *buff, const size_t &length, const size_t &index) {
+    for(size_t i = 0; i < length; i++) {
+        buff[i] = patternAt(index + i);
+    }
+}
+
+// returns false and says where if the length bytes in buff aren't the pattern starting at index
+inline bool matches(const char *buff, const size_t &length, const size_t &index) {
+    for(size_t i = 0; i < length; i++) {
+        if((unsigned char) buff[i] != patternAt(index + i)) {
+            std::cerr << "Byte " << index + i << " is " << (int) (unsigned char) buff[i] << " instead of " << (int) patternAt(index + i) << ".\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// reads length bytes of the pattern from conn, starting at index
+inline bool receivePattern(CommConnection &conn, const size_t &index, const size_t &length) {
+    char buff[BUFF_SIZE];
+    for(size_t received = 0; received < length;) {
+        unsigned int count = conn.waitForData(TIMEOUT);
+        if(count == 0) {
+            std::cerr << "Timed out after " << received << " of " << length << " bytes.\n";
+            return false;
+        }
+        if(count > BUFF_SIZE) {
+            count = BUFF_SIZE;
+        }
+        if(count > length - received) {
+            count = length - received;
+        }
+        conn.read(buff, count);
+        if(!matches(buff, count, index + received)) {
+            return false;
+        }
+        received += count;
+    }
+    return true;
+}
+
+// reads length bytes of the pattern from the socket fd, starting at index
+inline bool drainPattern(const int &fd, const size_t &index, const size_t &length) {
+    char buff[BUFF_SIZE];
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    for(size_t received = 0; received < length;) {
+        if(poll(&pfd, 1, TIMEOUT) <= 0) {
+            std::cerr << "Timed out after " << received << " of " << length << " bytes.\n";
+            return false;
+        }
+        ssize_t result = recv(fd, buff, BUFF_SIZE, 0);
+        if(result <= 0) {
+            perror("recv");
+            return false;
+        }
+        if(!matches(buff, result, index + received)) {
+            return false;
+        }
+        received += result;
+    }
+    return true;
+}
+
+// finds a port of type that nothing is bound to, on IPv6 and IPv4 alike. Returns 0 if it can't
+inline int freePort(const int &type) {
+    int fd = socket(AF_INET6, type | SOCK_CLOEXEC, 0);
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    socklen_t length = sizeof(addr);
+    int port = 0;
+    if(fd >= 0 && bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0 && getsockname(fd, (struct sockaddr *) &addr, &length) == 0) {
+        port = ntohs(addr.sin6_port);
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    return port;
+}
+
+// listens on an ephemeral port of the loopback interface and sets port to it. Returns -1 if it can't
+inline int listenOnLoopback(int &port) {
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listener < 0) {
+        perror("socket");
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if(bind(listener, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listener, 4) != 0 ||
+            getsockname(listener, (struct sockaddr *) &addr, &length) != 0) {
+        perror("bind");
+        close(listener);
+        return -1;
+    }
+    port = ntohs(addr.sin_port);
+    return listener;
+}
+
+// accepts the client that connected to listener, waiting at most TIMEOUT. Returns -1 if none did
+inline int acceptClient(const int &listener) {
+    struct pollfd pfd;
+    pfd.fd = listener;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, TIMEOUT) <= 0) {
+        std::cerr << "Timed out waiting for the connection to connect.\n";
+        return -1;
+    }
+    return accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+}
+
+#endif // TESTPATTERN_H
@@ -0,0 +1,103 @@
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "../src/UnixConnection.h"
+#include "TestPattern.h"
+
+// the most bytes one message holds
+#define MESSAGE_SIZE 1400
+
+const std::string helpText("Usage:\n\tUnixConnectionTest [-h] [-n <bytes>]\n\n\t"
+        "Connects UnixConnections over stream, datagram and seqpacket sockets, at a path in the file system and at\n\t"
+        "abstract addresses, and streams a pattern in messages of many lengths from the client to the server and a\n\t"
+        "reply back, checking every byte.\n\n\t"
+        "-h shows this help text\n\t"
+        "-n <bytes> = how many bytes are sent over each socket type. Defaults to 4194304.\n"
+        );
+
+// how a connection is made
+struct Mode {
+    const char *name;
+    int socketType;
+    // whether the path is in the abstract namespace instead of the file system
+    bool abstract;
+};
+
+// sends the pattern from a client to a server of mode as messages of many lengths, and a reply back
+bool checkMode(const Mode &mode, const size_t &bytes) {
+    std::string path = (mode.abstract ? "@" : "/tmp/") + std::string("UnixConnectionTest") + std::to_string(getpid());
+    UnixConnection *server = NULL;
+    // a stream or seqpacket server waits for the client in its constructor
+    std::thread accepting([&]() {
+        server = new UnixConnection(path.c_str(), mode.socketType, true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    UnixConnection client(path.c_str(), mode.socketType);
+    accepting.join();
+    bool ok = server->isConnected() && client.isConnected() && server->begin() && client.begin();
+    if(!ok) {
+        std::cerr << "Could not set up the connections.\n";
+    }
+    if(ok) {
+        std::atomic<bool> sent(true);
+        std::thread writer([&]() {
+            char buff[MESSAGE_SIZE];
+            for(size_t done = 0, round = 0; done < bytes; round++) {
+                size_t count = 1 + (round * 389) % MESSAGE_SIZE;
+                if(count > bytes - done) {
+                    count = bytes - done;
+                }
+                fillPattern(buff, count, done);
+                if(!client.write(buff, count)) {
+                    perror("UnixConnection::write");
+                    sent.store(false);
+                    return;
+                }
+                done += count;
+            }
+        });
+        ok = receivePattern(*server, 0, bytes);
+        writer.join();
+        ok = ok && sent.load();
+    }
+    if(ok) {
+        // a datagram server answers whoever it last heard from, which is the client
+        char buff[MESSAGE_SIZE];
+        fillPattern(buff, MESSAGE_SIZE, bytes);
+        ok = server->write(buff, MESSAGE_SIZE) && receivePattern(client, bytes, MESSAGE_SIZE);
+    }
+    client.terminate();
+    server->terminate();
+    delete server;
+    if(!mode.abstract && access(path.c_str(), F_OK) == 0) {
+        std::cerr << "The server left its socket file at " << path << ".\n";
+        unlink(path.c_str());
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    size_t bytes = 4 * 1024 * 1024;
+    SizeOption options[] = {
+        {"-n", "bytes", &bytes, 1}
+    };
+    int result = parseOptions(argc, argv, helpText, options, 1);
+    if(result >= 0) {
+        return result;
+    }
+    Mode modes[] = {
+        {"stream", SOCK_STREAM, false},
+        {"datagram", SOCK_DGRAM, true},
+        {"seqpacket", SOCK_SEQPACKET, true}
+    };
+    int failures = 0;
+    for(size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        printf("%s\n", modes[i].name);
+        if(!checkMode(modes[i], bytes)) {
+            std::cerr << modes[i].name << " failed.\n";
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "../src/NetworkConnection.h"
+#include "../src/UringReactor.h"
+#include "TestPattern.h"
+
+// how many pieces the write check splits its data into, so they have to go out in order
+#define WRITE_PIECES 4
+
+const std::string helpText("Usage:\n\tUringReactorTest [-h] [-n <bytes>] [-w <bytes>]\n\n\t"
+        "Connects NetworkConnections to a listening socket on the loopback interface and reads them with a\n\t"
+        "UringReactor, with one that has a kernel thread poll its submissions, and with an IoReactor, which is what\n\t"
+        "a UringReactor falls back to when io_uring isn't available. The peer streams a pattern in bursts so reads\n\t"
+        "find nothing and wait for the socket to be readable, an idle connection is removed while its read is in\n\t"
+        "flight, and the reactor writes more than the socket holds so the write is only partly sent and resubmitted.\n\n\t"
+        "-h shows this help text\n\t"
+        "-n <bytes> = how many bytes are streamed to each reactor. Defaults to 16777216.\n\t"
+        "-w <bytes> = how many bytes each reactor writes. Defaults to 8388608.\n"
+        );
+
+// how a connection is read from
+struct Mode {
+    const char *name;
+    bool uring;
+    unsigned int sqPollMillis;
+};
+
+// writes the pattern from index to index+length to fd, in bursts with pauses between them so the reader runs dry
+bool sendPattern(const int &fd, const size_t &index, const size_t &length) {
+    char buff[BUFF_SIZE];
+    for(size_t sent = 0, round = 0; sent < length; round++) {
+        size_t count = 1 + (round * 1777) % BUFF_SIZE;
+        if(count > length - sent) {
+            count = length - sent;
+        }
+        fillPattern(buff, count, index + sent);
+        for(size_t done = 0; done < count;) {
+            ssize_t result = send(fd, buff + done, count - done, MSG_NOSIGNAL);
+            if(result <= 0) {
+                perror("send");
+                return false;
+            }
+            done += result;
+        }
+        sent += count;
+        if(round % 64 == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    return true;
+}
+
+// writes length bytes of the pattern to conn through reactor in WRITE_PIECES pieces, which the ring submits again
+// whenever the socket only takes part of one, while the peer on fd reads them
+bool checkWrite(IoReactor &reactor, const bool &uring, NetworkConnection &conn, const int &fd, const size_t &length) {
+    std::vector<char> data(length);
+    fillPattern(&data[0], length, 0);
+    std::atomic<bool> ok(true);
+    std::thread peer([&]() {
+        // waits a moment first so the writes fill the socket
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ok.store(drainPattern(fd, 0, length) && ok.load());
+    });
+    size_t piece = length / WRITE_PIECES;
+    std::atomic<size_t> written(0);
+    std::atomic<int> finished(0);
+    for(int i = 0; i < WRITE_PIECES; i++) {
+        const char *start = &data[i * piece];
+        size_t pieceLength = i == WRITE_PIECES - 1 ? length - i * piece : piece;
+        if(uring) {
+            // held back until the last one, so they are all handed over in one submission
+            UringWriteCallback callback = [&, start](CommConnection *, const char *buff, const int &result) {
+                if(buff != start || result < 0) {
+                    ok.store(false);
+                } else {
+                    written += result;
+                }
+                finished++;
+            };
+            if(!((UringReactor &) reactor).write(&conn, start, pieceLength, callback, i == WRITE_PIECES - 1)) {
+                std::cerr << "Could not submit write " << i << ".\n";
+                ok.store(false);
+                finished++;
+            }
+        } else if(conn.write(start, pieceLength)) {
+            written += pieceLength;
+            finished++;
+        } else {
+            perror("NetworkConnection::write");
+            ok.store(false);
+            finished++;
+        }
+    }
+    for(int waited = 0; finished.load() < WRITE_PIECES && waited < TIMEOUT; waited++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    peer.join();
+    if(finished.load() < WRITE_PIECES) {
+        std::cerr << "Only " << finished.load() << " of " << WRITE_PIECES << " writes finished.\n";
+        return false;
+    } else if(written.load() != length) {
+        std::cerr << "The writes said they sent " << written.load() << " of " << length << " bytes.\n";
+        return false;
+    }
+    return ok.load();
+}
+
+// runs every check on new connections read by a reactor of mode. Returns false if any of them failed or lost data
+bool runMode(const Mode &mode, const size_t &bytes, const size_t &writeBytes) {
+    IoReactor *reactor;
+    bool uring = false;
+    if(mode.uring) {
+        UringReactor *ringReactor = new UringReactor(1, false, mode.sqPollMillis);
+        uring = ringReactor->isUsingUring();
+        if(!uring) {
+            printf("io_uring isn't available, so %s falls back to epoll\n", mode.name);
+        }
+        reactor = ringReactor;
+    } else {
+        reactor = new IoReactor();
+    }
+    int port;
+    int listener = listenOnLoopback(port);
+    if(listener < 0) {
+        delete reactor;
+        return false;
+    }
+    // polling connections, so their sockets don't block and a read that finds nothing has to wait to be readable
+    NetworkConnection conn(port, SOCK_STREAM, "127.0.0.1", 0);
+    int fd = acceptClient(listener);
+    NetworkConnection idle(port, SOCK_STREAM, "127.0.0.1", 0);
+    int idleFd = acceptClient(listener);
+    close(listener);
+    bool ok = fd >= 0 && idleFd >= 0 && reactor->begin() && conn.begin(reactor) && idle.begin(reactor);
+    if(!ok) {
+        std::cerr << "Could not set up the connections.\n";
+    }
+    if(ok) {
+        // its read is in flight, so the remove has to cancel it and wait for the kernel to give the buffer back
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        idle.terminate();
+        double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(millis > TIMEOUT || reactor->size() != 1) {
+            std::cerr << "Removing the idle connection took " << millis << " ms and left " << reactor->size() << " connections.\n";
+            ok = false;
+        }
+    }
+    if(ok) {
+        std::atomic<bool> sent(false);
+        std::thread peer([&]() {
+            sent.store(sendPattern(fd, 0, bytes));
+        });
+        ok = receivePattern(conn, 0, bytes);
+        peer.join();
+        ok = ok && sent.load();
+    }
+    if(ok) {
+        ok = checkWrite(*reactor, uring, conn, fd, writeBytes);
+    }
+    conn.terminate();
+    reactor->terminate();
+    if(fd >= 0) {
+        close(fd);
+    }
+    if(idleFd >= 0) {
+        close(idleFd);
+    }
+    delete reactor;
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    size_t bytes = 16 * 1024 * 1024, writeBytes = 8 * 1024 * 1024;
+    SizeOption options[] = {
+        {"-n", "bytes", &bytes, 0},
+        {"-w", "bytes", &writeBytes, WRITE_PIECES}
+    };
+    int result = parseOptions(argc, argv, helpText, options, 2);
+    if(result >= 0) {
+        return result;
+    }
+    Mode modes[] = {
+        {"io_uring", true, 0},
+        {"io_uring with SQPOLL", true, 10},
+        {"epoll", false, 0}
+    };
+    int failures = 0;
+    for(size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        printf("%s\n", modes[i].name);
+        if(!runMode(modes[i], bytes, writeBytes)) {
+            std::cerr << modes[i].name << " failed.\n";
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}